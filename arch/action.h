@@ -9,6 +9,8 @@
 
 #pragma once
 #include <algorithm>
+#include <cstdint>
+#include <type_traits>
 #include <unordered_map>
 #include <string>
 #include "board.h"
@@ -118,3 +120,30 @@ protected:
 	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) white(*a); }
 	static __attribute__((constructor)) void init() { entries()[type_flag('W')] = new white; }
 };
+
+/**
+ * the compact form of a placing action, a plain 4-byte value used by the episodes and the agents
+ * it is applied directly to the board without the lookup and the virtual call of action::apply,
+ * and converts from and to action for the I/O
+ */
+struct placement {
+	int16_t position;
+	uint8_t who;
+
+	placement() = default;
+	placement(int position, unsigned who) : position(position), who(who) {}
+	placement(const action& a) : position(-1), who(board::empty) {
+		unsigned type = a.type();
+		if (type == action::place::type || type == action::black::type || type == action::white::type) {
+			position = int16_t(a.event() & 0xffff);
+			who = (a.event() >> 16) & 0xff;
+		}
+	}
+	operator action() const { return action::place(position, who); }
+
+	board::reward apply(board& b) const {
+		if (unsigned(position) < unsigned(board::size_x * board::size_y)) return b.place_at(position, who);
+		return position == -1 ? board::illegal_pass : board::illegal_out_of_range;
+	}
+};
+static_assert(std::is_pod<placement>::value, "placement should be a plain value");
@@ -9,6 +9,10 @@
 
 #pragma once
 #include "mcts/mcts_management.h"
+#include "mcts/time_control.h"
+#include "mcts/telemetry.h"
+#include "mcts/workers.h"
+#include "scheduler.h"
 #include <unordered_map>
 #include <map>
 #include <thread>
@@ -32,6 +36,10 @@ public:
 	virtual void close_episode(const std::string& flag = "") {}
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
+	virtual void ponder(const board& b) {}
+	virtual bool analyze(const board& b, int interval, std::ostream& out) { return false; }
+	virtual void stop_analyze() {}
+	virtual bool root_visits(std::vector<std::pair<int, int>>& visits) const { return false; }
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
@@ -44,6 +52,9 @@ public:
 	virtual int total_simulation_time() const { return stoi(property("T"))/36; }
 	virtual int thread_num() const { return stoi(property("thread")); }
 	virtual int time_management_mode() const { return stoi(property("tm")); }
+	virtual bool ponder_mode() const { return stoi(property("ponder")); }
+	virtual int time_margin() const { return stoi(property("margin")); }
+	virtual bool adaptive_mode() const { return stoi(property("adaptive")); }
 
 protected:
 	typedef std::string key;
@@ -75,13 +86,13 @@ public:
 		if (who == board::empty)
 			throw std::invalid_argument("invalid role: " + role());
 		for (size_t i = 0; i < space.size(); i++)
-			space[i] = action::place(i, who);
+			space[i] = placement(i, who);
 	}
 
 	virtual ~basic_agent_func() {}
 
 protected:
-	std::vector<action::place> space;
+	std::vector<placement> space;
 	board::piece_type who;
 	int play_step;
 };
@@ -95,7 +106,7 @@ public:
 	random_action(const std::string& args = "") : basic_agent_func(args){}
 	virtual action take_action(const board& state) {
 		std::shuffle(space.begin(), space.end(), engine);
-		for (const action::place& move : space) {
+		for (const placement& move : space) {
 			board after = state;
 			if (move.apply(after) == board::legal)
 				return move;
@@ -109,7 +120,7 @@ public:
 	heuristic_action(const std::string& args = "") : basic_agent_func(args){}
 	virtual action take_action(const board& state) {
 		std::shuffle(space.begin(), space.end(), engine);
-		for (const action::place& move : space) {
+		for (const placement& move : space) {
 			board after = state;
 			if (move.apply(after) == board::legal)
 				return move;
@@ -120,47 +131,344 @@ public:
 
 class mcts_action : public basic_agent_func{
 public:
-	mcts_action(const std::string& args = ""): basic_agent_func(args), args_(args), thread_num_(1), time_management_mode_(time_management_mode()){
-		std::cout << "0" << std::endl;
+	mcts_action(const std::string& args = ""): basic_agent_func(args), args_(args), game_step(0), thread_num_(1), time_management_mode_(time_management_mode()), time_limit_(0), time_bank_(0), mem_limit_(0), seed_(0), seeded_(false), deterministic_(false), symmetric_(false), curve_a_(time_management_mode_ == 2 ? 2.19 : 1.9), curve_b_(time_management_mode_ == 2 ? 0.055 : 0.046), ponder_stop_(false){
 		if (thread_num() != 1) thread_num_ = thread_num();
+		if (meta.find("telemetry") != meta.end()) telemetry_ = telemetry(property("telemetry"));
+		if (meta.find("mem") != meta.end()) mem_limit_ = double(meta["mem"]) * (1 << 20); // in MiB
+		if (mem_limit_) node_bytes_counted() = true; // the players are created before any tree, see node_bytes
+		if (meta.find("seed") != meta.end()) seed_ = uint64_t(meta["seed"]), seeded_ = true;
+		if (meta.find("deterministic") != meta.end()) deterministic_ = int(meta["deterministic"]);
+		if (meta.find("symmetry") != meta.end()) symmetric_ = int(meta["symmetry"]);
+		if (meta.find("tm_a") != meta.end()) curve_a_ = double(meta["tm_a"]);
+		if (meta.find("tm_b") != meta.end()) curve_b_ = double(meta["tm_b"]);
+		if (meta.find("sync") != meta.end() && int(meta["sync"]) > 0 && thread_num_ > 1){
+			sync_ = std::make_shared<sync_board>(thread_num_, int(meta["sync"]));
+		}
+		if (meta.find("workers") != meta.end() && int(meta["workers"]) > 1){ // the coordinator is one of the workers
+			workers_ = std::make_shared<worker_pool>(int(meta["workers"]) - 1,
+				[this](const worker_job& job, const int& index, const std::atomic<bool>* stop){ return search_job(job, index, stop); });
+		}
+	}
+	virtual ~mcts_action() { release_tree(); }
+	virtual void notify(const std::string& msg) {
+		basic_agent_func::notify(msg);
+		std::string key = msg.substr(0, msg.find('='));
+		if(key == "time_settings") clock_.settings(property(key));
+		if(key == "time_left") clock_.left(property(key));
 	}
-	virtual void close_episode(const std::string& flag = "") {game_step=0;}
+	virtual void close_episode(const std::string& flag = "") {game_step=0; time_bank_=0; release_tree();}
 	
 	std::unordered_map<int, int> thread_simulate_result(const board& state){
-		std::vector<std::thread> threads;
-		std::vector<mcts_management> thread_mcts;
-		std::vector<node*> thread_mcts_root;
-		if(total_simulation_time() != 277) time_limit_ = millisec() + setup_time(total_simulation_time(), game_step);
-
-
-		for(int i=0;i<thread_num_;i++){
-			node* thread_root = new node(state);
-			thread_mcts_root.push_back(thread_root);
-			mcts_management tmp_mcts(who, game_step, total_simulation_count(), total_simulation_time(), time_limit_, mcts_c());
-			thread_mcts.push_back(std::move(tmp_mcts));
-			std::thread th(thread_mcts[i], state, thread_root);
-			threads.push_back(std::move(th));
+		std::vector<node*> thread_mcts_root = reuse_tree(state);
+		uint64_t start = millisec();
+		bool timed = !deterministic_ && (clock_.enabled() || total_simulation_time() != 277);
+		uint64_t hard_limit = 0;
+		if(clock_.enabled()){
+			time_limit_ = start + clock_.allocate(state, time_margin());
+			hard_limit = start + clock_.reserve(state, time_margin());
+		}else if(timed){ // the time saved by stopping early is banked for the next moves
+			int budget = setup_time(total_simulation_time(), game_step);
+			time_limit_ = start + budget + time_bank_;
+			hard_limit = time_limit_ + budget / 2;
 		}
 
-		for(int i=0;i<thread_num_;i++){
-			threads[i].join();
+
+		if(workers_) workers_->start({ state, game_step, timed, time_limit_, hard_limit });
+		std::vector<search_stats> thread_stats(thread_num_);
+		run_threads(state, thread_mcts_root, timed, hard_limit, telemetry_.enabled() ? &thread_stats : nullptr, nullptr);
+		uint64_t end = millisec();
+		clock_.spend(end - start);
+		if(timed && !clock_.enabled()){
+			time_bank_ = banked(time_limit_, end, setup_time(total_simulation_time(), game_step));
 		}
 		
 		std::unordered_map<int, int> node_table;
 
 		for(auto ro : thread_mcts_root){
 			for(auto n : ro->level_vector){
-				node_table[n->move_position] += n->visit_count;
-				delete n;
+				node_table[n->move_position] += n->own_visits();
 			}
 		}
+		if(workers_) workers_->merge(node_table, deterministic_ ? 0 : std::max(end, hard_limit) + 1000);
 		// std::cout << state;
+		if(telemetry_.enabled()){
+			telemetry_.write(game_step, role(), end - start, best_move(node_table), node_table, thread_stats);
+		}
 
+		if(ponder_mode()){ // keep the trees, the next ponder() continues from our move
+			tree_state_ = state;
+			tree_roots_ = thread_mcts_root;
+		}else{
+			for(auto ro : thread_mcts_root) delete ro;
+		}
 		return node_table;
 	}
+
+	/**
+	 * run one search thread on each root until the rules of the search stop them or the stop flag is raised
+	 * with seed=, every thread searches with its own random stream derived from the seed, the move number,
+	 * and the stream index, otherwise from the clock; in the deterministic mode, every thread runs the
+	 * count of simulations and caps the memory of its own tree
+	 * with sync=, the threads exchange their root statistics every that many simulations (not in the deterministic mode)
+	 */
+	void run_threads(const board& state, const std::vector<node*>& roots, const bool& timed, const uint64_t& hard_limit,
+		std::vector<search_stats>* stats, const std::atomic<bool>* stop, const int& stream = 0){
+		std::vector<mcts_management> searches;
+		bool sync = sync_ && !deterministic_;
+		if(sync) sync_->reset();
+		for(int i=0;i<thread_num_;i++){
+			mcts_management tmp_mcts(who, game_step, total_simulation_count(), total_simulation_time(), time_limit_, mcts_c());
+			if(timed) tmp_mcts.timed(time_limit_, hard_limit, game_step, adaptive_mode());
+			if(stats) tmp_mcts.report(&(*stats)[i]);
+			if(stop) tmp_mcts.interrupt(stop);
+			if(sync) tmp_mcts.synchronize(sync_.get(), i);
+			tmp_mcts.symmetry(symmetric_);
+			if(seeded_ || deterministic_) tmp_mcts.seed(stream_seed(seed_, game_step, stream + i));
+			if(deterministic_){
+				tmp_mcts.counted(total_simulation_count());
+				tmp_mcts.memory(mem_limit_ / thread_num_, true);
+			}else{
+				tmp_mcts.memory(mem_limit_);
+			}
+			searches.push_back(tmp_mcts);
+		}
+		if(scheduler::instance().enabled()){
+			run_tasks(state, roots, searches);
+			return;
+		}
+		std::vector<std::thread> threads;
+		for(int i=0;i<thread_num_;i++) threads.emplace_back(searches[i], state, roots[i]);
+		for(auto& th : threads) th.join();
+	}
+
+	/**
+	 * run the searches on the process-wide scheduler instead, every tree is searched in chunks of
+	 * simulations, so the trees share the free cores, and all of them still stop at the deadline
+	 * even if they run one after another on the thread waiting for them
+	 */
+	void run_tasks(const board& state, const std::vector<node*>& roots, std::vector<mcts_management>& searches){
+		const int chunk = 128;
+		task_group group;
+		std::function<void(int)> search = [&](int i){
+			if(!searches[i].advance(state, roots[i], chunk)) group.run([&search, i](){ search(i); });
+		};
+		for(int i=0;i<thread_num_;i++){
+			searches[i].begin(roots[i]);
+			group.run([&search, i](){ search(i); });
+		}
+		group.wait();
+		for(auto& s : searches) s.finish();
+	}
+
+	/**
+	 * the bank left after a search which ended at end, the limit already includes the bank it was given,
+	 * so the time before the limit is the whole new bank, which is capped at one budget
+	 */
+	static int64_t banked(const uint64_t& limit, const uint64_t& end, const int64_t& cap){
+		return std::max<int64_t>(0, std::min<int64_t>(int64_t(limit) - int64_t(end), cap));
+	}
+
+	/**
+	 * the seed of a random stream, mixed with splitmix64 so that nearby streams are unrelated
+	 */
+	static uint64_t stream_seed(const uint64_t& seed, const int& step, const int& stream){
+		uint64_t z = seed + 0x9e3779b97f4a7c15ull * (uint64_t(step) * 1024 + stream + 1);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	/**
+	 * the most visited move, the ties go to the lowest position so that the order of the table does not matter
+	 */
+	static int best_move(const std::unordered_map<int, int>& table){
+		int best = -1, most = -1;
+		for(auto subn : table){
+			if(subn.second > most || (subn.second == most && subn.first < best)){
+				best = subn.first;
+				most = subn.second;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * the search of a worker process, on fresh trees with the limits chosen by the coordinator
+	 */
+	std::unordered_map<int, int> search_job(const worker_job& job, const int& index, const std::atomic<bool>* stop){
+		game_step = job.game_step;
+		time_limit_ = job.time_limit;
+		std::vector<node*> roots;
+		for(int i=0;i<thread_num_;i++) roots.push_back(new node(job.state));
+		run_threads(job.state, roots, job.timed, job.hard_limit, nullptr, stop, (index + 1) * thread_num_);
+		std::unordered_map<int, int> node_table;
+		for(auto ro : roots){
+			for(auto n : ro->level_vector) node_table[n->move_position] += n->own_visits();
+			delete ro;
+		}
+		return node_table;
+	}
+
+	/**
+	 * keep searching the given position in the background, usually the position right after
+	 * a move has been played, until the next ponder() or take_action() arrives
+	 * the subtree matching the new position is kept and the rest of the trees are discarded
+	 */
+	virtual void ponder(const board& state){
+		if(!ponder_mode() || deterministic_) return;
+		std::vector<node*> roots = reuse_tree(state);
+		ponder_stop_ = false;
+		for(int i=0;i<thread_num_;i++){
+			mcts_management tmp_mcts(who, game_step, total_simulation_count(), total_simulation_time(), time_limit_, mcts_c());
+			if(seeded_) tmp_mcts.seed(stream_seed(~seed_, game_step, i)); // apart from the streams of the searches
+			ponder_threads_.emplace_back(tmp_mcts.ponder(&ponder_stop_).memory(mem_limit_).symmetry(symmetric_), state, roots[i]);
+		}
+		tree_state_ = state;
+		tree_roots_ = roots;
+	}
+
+	/**
+	 * search the given position in the background like ponder(), and print the top candidates
+	 * every interval milliseconds in the format of lz-analyze, until stop_analyze() is called
+	 * the tree keeps growing across analyses of the same position and is reused by take_action()
+	 */
+	virtual bool analyze(const board& state, int interval, std::ostream& out){
+		std::vector<node*> roots = reuse_tree(state);
+		ponder_stop_ = false;
+		analysis_.slots.assign(thread_num_, {});
+		for(int i=0;i<thread_num_;i++){
+			mcts_management tmp_mcts(who, game_step, total_simulation_count(), total_simulation_time(), time_limit_, mcts_c());
+			if(seeded_) tmp_mcts.seed(stream_seed(~seed_, game_step, i)); // apart from the streams of the searches
+			ponder_threads_.emplace_back(tmp_mcts.ponder(&ponder_stop_).memory(mem_limit_).symmetry(symmetric_).publish(&analysis_, i, interval), state, roots[i]);
+		}
+		tree_state_ = state;
+		tree_roots_ = roots;
+		ponder_threads_.emplace_back([this, interval, &out](){
+			for(uint64_t next = millisec() + interval; !ponder_stop_; ){
+				if(millisec() < next){
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+					continue;
+				}
+				report_analysis(out);
+				next += interval;
+			}
+		});
+		return true;
+	}
+
+	virtual void stop_analyze(){
+		stop_ponder();
+	}
+
+	/**
+	 * merge the summaries published by the threads and print the top candidates on one line
+	 */
+	void report_analysis(std::ostream& out, const size_t& top = 10){
+		std::map<int, root_summary> merged;
+		std::map<int, double> pv_visits;
+		{
+			std::lock_guard<std::mutex> guard(analysis_.lock);
+			for(const auto& slot : analysis_.slots){
+				for(const root_summary& s : slot){
+					root_summary& m = merged[s.move];
+					if(s.visits > pv_visits[s.move]){ // the pv of the thread that searched it most
+						pv_visits[s.move] = s.visits;
+						m.pv = s.pv;
+					}
+					m.move = s.move;
+					m.visits += s.visits;
+					m.wins += s.wins;
+				}
+			}
+		}
+		std::vector<root_summary> order;
+		for(auto& m : merged) order.push_back(m.second);
+		std::sort(order.begin(), order.end(), [](const root_summary& a, const root_summary& b){ return a.visits > b.visits; });
+		if(order.size() > top) order.resize(top);
+		if(order.empty()) return;
+		std::stringstream line;
+		for(size_t i=0;i<order.size();i++){
+			line << (i ? " " : "") << "info move " << board::point(order[i].move) << " visits " << int(order[i].visits)
+				<< " winrate " << int(order[i].wins * 10000 / order[i].visits) << " order " << i << " pv";
+			for(int mv : order[i].pv) line << " " << board::point(mv);
+		}
+		out << line.str() << std::endl;
+	}
+
+	void stop_ponder(){
+		ponder_stop_ = true;
+		for(auto& th : ponder_threads_) th.join();
+		ponder_threads_.clear();
+	}
+
+	void release_tree(){
+		stop_ponder();
+		for(auto ro : tree_roots_) delete ro;
+		tree_roots_.clear();
+	}
+
+	/**
+	 * take over the trees of the last search for the given position
+	 * the trees are reused as is if the position is unchanged, or re-rooted at the child of
+	 * the move leading to the position; otherwise brand new trees are created
+	 * when only one move of a symmetric set was expanded, the subtree of the expanded move is
+	 * taken over with the symmetry that maps it to the move played
+	 */
+	std::vector<node*> reuse_tree(const board& state){
+		stop_ponder();
+		std::vector<node*> roots;
+		int move = tree_roots_.size() ? played_move(tree_state_, state) : -1;
+		unsigned stable = move != -1 && symmetric_ ? tree_state_.stabilizer() : 1;
+		for(auto ro : tree_roots_){
+			if(tree_state_ == state && tree_state_.info().who_take_turns == state.info().who_take_turns){
+				roots.push_back(ro);
+				continue;
+			}
+			for(auto it = ro->level_vector.begin(); move != -1 && it != ro->level_vector.end(); it++){
+				unsigned s = 0;
+				while(s < board::symmetries() && !((stable >> s & 1) && board::transform((*it)->move_position, s) == move)) s++;
+				if(s == board::symmetries()) continue;
+				if(s){
+					(*it)->transform(s);
+					(*it)->canonicalize(state); // the children were pruned under the symmetries of the unmapped position
+				}
+				roots.push_back(*it);
+				ro->level_vector.erase(it);
+				break;
+			}
+			delete ro;
+		}
+		tree_roots_.clear();
+		if(roots.size() != size_t(thread_num_)){
+			for(auto ro : roots) delete ro;
+			roots.clear();
+			for(int i=0;i<thread_num_;i++) roots.push_back(new node(state));
+		}
+		return roots;
+	}
+
+	/**
+	 * find the only move which leads from one position to the other, or -1 if there is none
+	 */
+	static int played_move(const board& before, const board& after){
+		int move = -1;
+		for(int i=0;i<board::size_x*board::size_y;i++){
+			if(before(i) == after(i)) continue;
+			if(move != -1 || before(i) != board::empty) return -1;
+			move = i;
+		}
+		board test = before;
+		if(move == -1 || test.place(move) != board::legal || !(test == after)) return -1;
+		return move;
+	}
+
+	/**
+	 * the budget of a move from T, shaped by the curve of tm= over the move number,
+	 * (a - b*step) for tm=1 and (a - b*step)^2 for tm=2, where a and b are given by tm_a= and tm_b=
+	 */
 	int setup_time(const int& limit_range, const int& game_step){
-		if(time_management_mode_ == 1) return (1.9-0.046*game_step)*limit_range;
-		else if(time_management_mode_==2) return pow(1.39-(0.055*game_step-0.8),2)*limit_range;
+		if(time_management_mode_ == 1) return (curve_a_-curve_b_*game_step)*limit_range;
+		else if(time_management_mode_==2) return pow(curve_a_-curve_b_*game_step,2)*limit_range;
 		else return limit_range;
 	}
 
@@ -174,15 +482,17 @@ public:
 	}
 
 	uint64_t millisec() {
-		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		return time_compare::millisec();
 	}
 
 	virtual int heur_action(const board& state){
-		board tmp = state;
-		if(tmp.place(4) == board::legal) return 4;
-		if(tmp.place(36) == board::legal) return 36;
-		if(tmp.place(44) == board::legal) return 44;
-		if(tmp.place(76) == board::legal) return 76;
+		// the middle points of the four edges, e.g., A5, E1, E9, J5 on 9x9
+		const board::point edge[] = { { 0, board::size_y / 2 }, { board::size_x / 2, 0 },
+			{ board::size_x / 2, board::size_y - 1 }, { board::size_x - 1, board::size_y / 2 } };
+		for(const board::point& p : edge){
+			board tmp = state;
+			if(tmp.place(p) == board::legal) return p.i;
+		}
 		return -1;
 	}
 
@@ -197,7 +507,17 @@ public:
 	// 	return -1;
 	// }
 
+	/**
+	 * the merged root visits of the last take_action(), or false if the move was not searched
+	 */
+	virtual bool root_visits(std::vector<std::pair<int, int>>& visits) const {
+		if(last_visits_.empty()) return false;
+		visits = last_visits_;
+		return true;
+	}
+
 	virtual action take_action(const board& state) {
+		last_visits_.clear();
 		if(game_step <= 4){
 			int move = heur_action(state);
 			if(move != -1) return action::place(move, who);
@@ -205,16 +525,9 @@ public:
 		
 
 		std::unordered_map<int, int> mcts_root = thread_simulate_result(state);
+		last_visits_.assign(mcts_root.begin(), mcts_root.end());
 		if(mcts_root.size() == 0) return action();
-		int max_visit_pos = -1;
-		int max_visit_time = -1;
-
-		for(auto subn : mcts_root){
-			if(subn.second > max_visit_time){
-				max_visit_pos = subn.first;
-				max_visit_time = subn.second;
-			}
-		}
+		int max_visit_pos = best_move(mcts_root);
 		game_step++;
         return action::place(max_visit_pos, who);
 	}
@@ -225,7 +538,26 @@ private:
 	int thread_num_;
 	int time_management_mode_;
 	uint64_t time_limit_;
+	int64_t time_bank_;
+	int64_t mem_limit_;
+	uint64_t seed_;
+	bool seeded_;
+	bool deterministic_;
+	bool symmetric_;
+	double curve_a_;
+	double curve_b_;
 	std::vector<int> mirror_v;
+	time_control clock_;
+	telemetry telemetry_;
+
+	board tree_state_;
+	std::vector<node*> tree_roots_;
+	std::vector<std::thread> ponder_threads_;
+	std::atomic<bool> ponder_stop_;
+	analysis_board analysis_;
+	std::vector<std::pair<int, int>> last_visits_;
+	std::shared_ptr<worker_pool> workers_;
+	std::shared_ptr<sync_board> sync_;
 };
 
 
@@ -233,18 +565,32 @@ private:
 class player : public basic_agent_func {
 public:
 	player(const std::string& args = "") : basic_agent_func(args), args_(args) {
-		// std::cout << args << std::endl;
 		if (search() == "mcts"){
-			std::cout << "mcts" << std::endl;
 			policy = new mcts_action(args);
 		}else{
-			std::cout << "random" << std::endl;
 			policy = new random_action(args);
 		}
 	}
+	virtual ~player() { delete policy; }
 	virtual action take_action(const board& state) {
 		return policy->take_action(state);
 	}
+	virtual void ponder(const board& state) {
+		policy->ponder(state);
+	}
+	virtual void notify(const std::string& msg) {
+		basic_agent_func::notify(msg);
+		policy->notify(msg);
+	}
+	virtual bool analyze(const board& state, int interval, std::ostream& out) {
+		return policy->analyze(state, interval, out);
+	}
+	virtual void stop_analyze() {
+		policy->stop_analyze();
+	}
+	virtual bool root_visits(std::vector<std::pair<int, int>>& visits) const {
+		return policy->root_visits(visits);
+	}
 	virtual void close_episode(const std::string& flag = "") {
 		policy->close_episode();
 	}
@@ -0,0 +1,243 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * arena.h: Play many local games concurrently on a pool of workers
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "scheduler.h"
+
+class arena {
+public:
+	/**
+	 * the full argument strings of both players, and the number of games played at once
+	 * every game gets its own players, seeded with seed + index when a seed is given
+	 */
+	arena(const std::string& black_args, const std::string& white_args, size_t parallel)
+		: args({ black_args, white_args }), seed({ base_seed(black_args), base_seed(white_args) }),
+		  parallel(std::max<size_t>(parallel, 1)) {}
+	virtual ~arena() {}
+
+public:
+	/**
+	 * play the remaining games of the statistics, the finished episodes are judged and merged in order
+	 * no more games are started once the arena is stopped, but the games in progress are completed
+	 */
+	void run(statistics& stats) {
+		size_t games = stats.remaining();
+		std::atomic<size_t> next(0);
+		std::mutex lock;
+		std::map<size_t, episode> finished;
+		size_t merged = 0;
+
+		auto worker = [&]() {
+			for (size_t i; !stopped() && (i = next++) < games; ) {
+				episode game;
+				play(i, game);
+				std::lock_guard<std::mutex> guard(lock);
+				finished[i] = std::move(game);
+				for (auto it = finished.find(merged); it != finished.end(); it = finished.find(++merged)) {
+					judge(merged, it->second);
+					stats.push_episode(it->second);
+					finished.erase(it);
+				}
+			}
+		};
+
+		spread(worker, std::min(parallel, games));
+	}
+
+	/**
+	 * play the i-th game with fresh players from beginning to end
+	 */
+	void play(size_t i, episode& game) {
+		size_t b = black_of(i), w = 1 - b;
+		player black(args[b] + " role=black seed=" + std::to_string((seed[b] + i) & 0x7fffffffu));
+		player white(args[w] + " role=white seed=" + std::to_string((seed[w] + i) & 0x7fffffffu));
+		black.open_episode("~:" + white.name());
+		white.open_episode(black.name() + ":~");
+
+		game.open_episode(black.name() + ":" + white.name());
+		while (true) {
+			agent& who = game.take_turns(black, white);
+			action move = who.take_action(game.state());
+			searched(i, game.state(), who);
+			if (game.apply_action(move) != true) break;
+			if (who.check_for_win(game.state())) break;
+		}
+		agent& win = game.last_turns(black, white);
+		game.close_episode(win.name());
+
+		black.close_episode(win.name());
+		white.close_episode(win.name());
+	}
+
+	/**
+	 * whether the arguments ask for worker processes, which the players of an arena cannot have,
+	 * since the players are created on the threads of the arena and a process with threads must not fork
+	 */
+	static bool forks(const std::string& args) {
+		int workers = 1;
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			if (pair.substr(0, pair.find('=')) == "workers") workers = std::stoi(pair.substr(pair.find('=') + 1));
+		}
+		return workers > 1;
+	}
+
+protected:
+	/**
+	 * run the worker on count threads, or as count tasks of the process-wide scheduler if it has a core budget
+	 */
+	static void spread(const std::function<void()>& worker, size_t count) {
+		if (scheduler::instance().enabled()) {
+			task_group group;
+			for (size_t i = 0; i < count; i++) group.run(worker);
+			group.wait();
+			return;
+		}
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < count; i++) workers.emplace_back(worker);
+		for (std::thread& th : workers) th.join();
+	}
+
+	/**
+	 * which of the two configurations plays black in the i-th game
+	 */
+	virtual size_t black_of(size_t i) const { return 0; }
+	/**
+	 * whether to stop starting new games
+	 */
+	virtual bool stopped() const { return false; }
+	/**
+	 * inspect the result of the i-th game, called in order
+	 */
+	virtual void judge(size_t i, const episode& game) {}
+	/**
+	 * inspect the position of the i-th game right after the agent chose its move, from any worker
+	 */
+	virtual void searched(size_t i, const board& state, const agent& who) {}
+
+	/**
+	 * the seed given in the arguments (the last one wins), or a random one
+	 */
+	static unsigned base_seed(const std::string& args) {
+		unsigned seed = std::random_device()();
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			if (pair.substr(0, pair.find('=')) == "seed") seed = std::stoul(pair.substr(pair.find('=') + 1));
+		}
+		return seed;
+	}
+
+protected:
+	std::array<std::string, 2> args;
+	std::array<unsigned, 2> seed;
+	size_t parallel;
+};
+
+/**
+ * sequential probability ratio test of configuration A against B, measured in elo
+ * the games are counted in pairs with swapped colors, and the log-likelihood ratio is
+ * approximated by the generalized SPRT on the pair scores {0, 1/2, 1}
+ */
+struct sprt {
+	double elo0, elo1, alpha, beta;
+	std::array<size_t, 3> pairs; // A loses both, splits, wins both
+
+	sprt(const std::string& args = "") : elo0(0), elo1(10), alpha(0.05), beta(0.05), pairs({ 0, 0, 0 }) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			double value = std::stod(pair.substr(pair.find('=') + 1));
+			if (key == "elo0") elo0 = value;
+			if (key == "elo1") elo1 = value;
+			if (key == "alpha") alpha = value;
+			if (key == "beta") beta = value;
+		}
+	}
+
+	static double score(double elo) { return 1 / (1 + std::pow(10, -elo / 400)); }
+	double lower() const { return std::log(beta / (1 - alpha)); }
+	double upper() const { return std::log((1 - beta) / alpha); }
+	size_t count() const { return pairs[0] + pairs[1] + pairs[2]; }
+
+	double llr() const {
+		size_t n = count();
+		if (n == 0) return 0;
+		// half a pseudo count per outcome keeps the variance sane for the first one-sided results
+		double p0 = pairs[0] + 0.5, p1 = pairs[1] + 0.5, p2 = pairs[2] + 0.5, m = p0 + p1 + p2;
+		double mean = (p1 * 0.5 + p2) / m;
+		double var = (p0 * mean * mean + p1 * (0.5 - mean) * (0.5 - mean) + p2 * (1 - mean) * (1 - mean)) / m;
+		double s0 = score(elo0), s1 = score(elo1);
+		return n * (s1 - s0) * (2 * mean - s0 - s1) / (2 * var);
+	}
+
+	/**
+	 * return +1 if H1 (A is elo1 stronger) is accepted, -1 if H0 is accepted, or 0 to continue
+	 */
+	int decision() const {
+		double v = llr();
+		return v >= upper() ? 1 : v <= lower() ? -1 : 0;
+	}
+
+	friend std::ostream& operator <<(std::ostream& out, const sprt& test) {
+		size_t n = test.count();
+		double mean = n ? (test.pairs[1] * 0.5 + test.pairs[2]) / n : 0.5;
+		double elo = (mean > 0 && mean < 1) ? -400 * std::log10(1 / mean - 1) : mean ? 999 : -999;
+		out << "sprt = " << test.llr() << " (" << test.lower() << "|" << test.upper() << "), ";
+		out << "pairs = " << n << " (" << test.pairs[2] << "|" << test.pairs[1] << "|" << test.pairs[0] << "), ";
+		out << "elo = " << elo;
+		return out;
+	}
+};
+
+/**
+ * match configuration A against B with alternating colors until the SPRT is decided
+ * configuration A plays black in the even games, and B plays black in the odd games
+ */
+class match : public arena {
+public:
+	match(const std::string& a_args, const std::string& b_args, size_t parallel, const std::string& sprt_args, size_t block)
+		: arena(a_args + " name=A", b_args + " name=B", parallel), test(sprt_args), block(block ? block : 1), result(0), first(false) {}
+
+	int decision() const { return result; }
+	const sprt& status() const { return test; }
+
+protected:
+	virtual size_t black_of(size_t i) const { return i % 2; }
+	virtual bool stopped() const { return result != 0; }
+	virtual void judge(size_t i, const episode& game) {
+		if (result != 0) return; // the games still in progress when decided are not counted
+		bool black_win = game.step() % 2 == 1;
+		bool a_win = black_win == (black_of(i) == 0);
+		if (i % 2 == 0) {
+			first = a_win;
+			return;
+		}
+		test.pairs[first + a_win]++;
+		result = test.decision();
+		if (test.count() % block == 0 || result != 0) std::cout << test << std::endl;
+	}
+
+private:
+	sprt test;
+	size_t block;
+	std::atomic<int> result;
+	bool first;
+};
@@ -0,0 +1,208 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * bench.cpp: Micro- and macro-benchmarks of the board and the search
+ *
+ * every result is printed as one JSON object per line, e.g.,
+ * {"bench":"board_place","ops":1000000,"ns_per_op":85.2}
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+class benchmark {
+public:
+	benchmark(const std::string& args = "") : seed(2022), positions(64), repeat(20), sims(2000), threads(std::max(1u, std::thread::hardware_concurrency())), sink(0) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			size_t value = std::stoull(pair.substr(pair.find('=') + 1));
+			if (key == "seed") seed = value;
+			if (key == "positions") positions = value;
+			if (key == "repeat") repeat = value;
+			if (key == "sims") sims = value;
+			if (key == "threads") threads = value;
+		}
+		generate();
+	}
+
+public:
+	void run() {
+		bench_place();
+		bench_check_liberty();
+		bench_legal_moves();
+		bench_rollout();
+		for (size_t n = 1; n <= threads; n++) bench_search(n);
+	}
+
+	/**
+	 * try every point of every position, on a fresh copy each time
+	 */
+	void bench_place() {
+		size_t ops = 0;
+		auto start = now();
+		for (size_t r = 0; r < repeat; r++) {
+			for (const board& state : fixed) {
+				for (int i = 0; i < board::size_x * board::size_y; i++) {
+					board after = state;
+					sink += after.place(i);
+					ops++;
+				}
+			}
+		}
+		report("board_place", ops, now() - start);
+	}
+
+	/**
+	 * flood the block of every stone of every position
+	 */
+	void bench_check_liberty() {
+		size_t ops = 0;
+		auto start = now();
+		for (size_t r = 0; r < repeat; r++) {
+			for (const board& state : fixed) {
+				for (int x = 0; x < board::size_x; x++) {
+					for (int y = 0; y < board::size_y; y++) {
+						unsigned who = state[x][y];
+						if (who != board::black && who != board::white) continue;
+						sink += state.check_liberty(x, y, who);
+						ops++;
+					}
+				}
+			}
+		}
+		report("check_liberty", ops, now() - start);
+	}
+
+	/**
+	 * list all the legal moves of a position
+	 */
+	void bench_legal_moves() {
+		size_t ops = 0;
+		auto start = now();
+		for (size_t r = 0; r < repeat; r++) {
+			for (const board& state : fixed) {
+				std::vector<int> moves;
+				for (int i = 0; i < board::size_x * board::size_y; i++) {
+					board after = state;
+					if (after.place(i) == board::legal) moves.push_back(i);
+				}
+				sink += moves.size();
+				ops++;
+			}
+		}
+		report("legal_moves", ops, now() - start);
+	}
+
+	void bench_rollout() {
+		mcts_tree tree(board::black, 0.3);
+		size_t ops = 0;
+		auto start = now();
+		for (size_t r = 0; r < repeat * 10; r++) {
+			for (const board& state : fixed) {
+				node root(state);
+				board after = state;
+				sink += tree.Rollout(&root, after);
+				ops++;
+			}
+		}
+		auto elapsed = now() - start;
+		std::stringstream extra;
+		extra << ",\"playouts_per_sec\":" << (ops * 1e9 / elapsed);
+		report("rollout", ops, elapsed, extra.str());
+	}
+
+	/**
+	 * root-parallel search of the initial position with a fixed count of simulations per thread
+	 */
+	void bench_search(size_t n) {
+		board state;
+		std::vector<node*> roots;
+		std::vector<std::thread> workers;
+		auto start = now();
+		for (size_t i = 0; i < n; i++) {
+			roots.push_back(new node(state));
+			workers.emplace_back(mcts_management(board::black, 0, sims, 277, 0, 0.3).seed(seed + i), state, roots.back());
+		}
+		for (std::thread& th : workers) th.join();
+		auto elapsed = now() - start;
+
+		size_t bytes = 0;
+		for (node* root : roots) {
+			bytes += memory(root);
+			delete root;
+		}
+		std::stringstream extra;
+		extra << ",\"threads\":" << n << ",\"sims_per_sec\":" << (sims * n * 1e9 / elapsed)
+		      << ",\"bytes_per_sim\":" << (bytes * 1.0 / (sims * n));
+		report("mcts_search", sims * n, elapsed, extra.str());
+	}
+
+protected:
+	/**
+	 * the positions reached by seeded random games, at several stages of the game
+	 */
+	void generate() {
+		std::default_random_engine engine(seed);
+		while (fixed.size() < positions) {
+			board state;
+			size_t depth = std::uniform_int_distribution<size_t>(0, 50)(engine);
+			std::vector<int> space(board::size_x * board::size_y);
+			for (size_t i = 0; i < space.size(); i++) space[i] = i;
+			for (size_t d = 0; d < depth; d++) {
+				std::shuffle(space.begin(), space.end(), engine);
+				bool moved = false;
+				for (int i : space) {
+					board after = state;
+					if (after.place(i) != board::legal) continue;
+					state = after;
+					moved = true;
+					break;
+				}
+				if (!moved) break;
+			}
+			fixed.push_back(state);
+		}
+	}
+
+	static size_t memory(const node* n) {
+		size_t bytes = n->bytes();
+		for (const node* child : n->level_vector) bytes += memory(child);
+		return bytes;
+	}
+
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * print a result line, extra holds the additional fields as ',"key":value'
+	 */
+	void report(const std::string& name, size_t ops, int64_t ns, const std::string& extra = "") {
+		std::cout << "{\"bench\":\"" << name << "\",\"ops\":" << ops << ",\"ns_per_op\":" << (ns * 1.0 / ops) << extra << "}" << std::endl;
+	}
+
+private:
+	size_t seed;
+	size_t positions;
+	size_t repeat;
+	size_t sims;
+	size_t threads;
+	std::vector<board> fixed;
+	size_t sink;
+};
+
+int main(int argc, const char* argv[]) {
+	std::string args;
+	for (int i = 1; i < argc; i++) args += std::string(argv[i]) + " ";
+	benchmark bench(args);
+	bench.run();
+	return 0;
+}
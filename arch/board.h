@@ -15,9 +15,12 @@
 #include <algorithm>
 #include <utility>
 #include <cmath>
+#include <cstring>
+#include "profile.h"
+#include "geometry.h"
 
 /**
- * definition for the 9x9 board
+ * definition for the board of the given geometry, the default one is the 9x9 Hollow NoGo board
  * note that there is no column 'I'
  *
  *   A B C D E F G H J
@@ -41,10 +44,14 @@
  *
  * for 9x9 Hollow NoGo, the empty locations are hollow but not empty, cannot be counted as liberty,
  * i.e., there are also borders at the center of the board
+ *
+ * the geometry is chosen while compiling with -DNOGO_GEOMETRY (see geometry.h and the makefile),
+ * and the whole engine is built for that geometry through the typedef board at the end
  */
-class board {
+template<class geometry>
+class basic_board {
 public:
-	enum size { size_x = 9u, size_y = 9u, hollow_x = 3u, hollow_y = 3u };
+	enum size { size_x = geometry::size_x, size_y = geometry::size_y };
 	enum piece_type { empty = 0u, black = 1u, white = 2u, hollow = 3u, unknown = -1u };
 	typedef uint32_t cell;
 	typedef std::array<cell, size_y> column;
@@ -56,10 +63,10 @@ public:
 	typedef int reward;
 
 public:
-	board() : stone(initial()), attr({piece_type::black}) {}
-	board(const grid& b, const data& d) : stone(b), attr(d) {}
-	board(const board& b) = default;
-	board& operator =(const board& b) = default;
+	basic_board() : stone(initial()), attr({piece_type::black}) {}
+	basic_board(const grid& b, const data& d) : stone(b), attr(d) {}
+	basic_board(const basic_board& b) = default;
+	basic_board& operator =(const basic_board& b) = default;
 
 	struct point {
 		int x, y, i;
@@ -90,12 +97,12 @@ public:
 	data info(data dat) { data old = attr; attr = dat; return old; }
 
 public:
-	bool operator ==(const board& b) const { return stone == b.stone; }
-	bool operator < (const board& b) const { return stone <  b.stone; }
-	bool operator !=(const board& b) const { return !(*this == b); }
-	bool operator > (const board& b) const { return b < *this; }
-	bool operator <=(const board& b) const { return !(b < *this); }
-	bool operator >=(const board& b) const { return !(*this < b); }
+	bool operator ==(const basic_board& b) const { return stone == b.stone; }
+	bool operator < (const basic_board& b) const { return stone <  b.stone; }
+	bool operator !=(const basic_board& b) const { return !(*this == b); }
+	bool operator > (const basic_board& b) const { return b < *this; }
+	bool operator <=(const basic_board& b) const { return !(b < *this); }
+	bool operator >=(const basic_board& b) const { return !(*this < b); }
 
 public:
 	enum nogo_move_result {
@@ -117,20 +124,32 @@ public:
 		if (who == -1u) who = attr.who_take_turns;
 		if (who != attr.who_take_turns) return nogo_move_result::illegal_turn;
 		if (x == -1 && y == -1) return nogo_move_result::illegal_pass;
-		point p_min(0, 0), p_max(size_x - 1, size_y - 1);
-		if (x < p_min.x || x > p_max.x || y < p_min.y || y > p_max.y) return nogo_move_result::illegal_out_of_range;
-		if (board::initial()[x][y] == piece_type::hollow)             return nogo_move_result::illegal_out_of_range;
-		board test = *this;
-		if (test[x][y] != piece_type::empty) return nogo_move_result::illegal_not_empty;
-		test[x][y] = who; // try put a piece first
-		if (!test.check_liberty(x, y, who)) return nogo_move_result::illegal_suicide;
+		if (x < 0 || x >= size_x || y < 0 || y >= size_y) return nogo_move_result::illegal_out_of_range;
+		return place_at(x * size_y + y, who);
+	}
+	/**
+	 * place a stone to the 1-d position i, which must be on the board, without any conversion
+	 */
+	reward place_at(int i, unsigned who = piece_type::unknown) {
+		PROFILE_SCOPE(board_place);
+		if (who == -1u) who = attr.who_take_turns;
+		if (who != attr.who_take_turns) return nogo_move_result::illegal_turn;
+		if (table::layout[i] == piece_type::hollow) return nogo_move_result::illegal_out_of_range;
+		cell& here = stone[i / size_y][i % size_y];
+		if (here != piece_type::empty) return nogo_move_result::illegal_not_empty;
+		here = who; // try put a piece first
+		if (!check_liberty(i, who)) {
+			here = piece_type::empty;
+			return nogo_move_result::illegal_suicide;
+		}
 		unsigned opp = 3u - who;
-		if (x > p_min.x && !test.check_liberty(x - 1, y, opp)) return nogo_move_result::illegal_take;
-		if (x < p_max.x && !test.check_liberty(x + 1, y, opp)) return nogo_move_result::illegal_take;
-		if (y > p_min.y && !test.check_liberty(x, y - 1, opp)) return nogo_move_result::illegal_take;
-		if (y < p_max.y && !test.check_liberty(x, y + 1, opp)) return nogo_move_result::illegal_take;
-		stone[x][y] = who; // is legal move!
-		attr.who_take_turns = static_cast<piece_type>(opp);
+		for (int near : table::neighbor[i].near) { // a neighbor out of the board is the point itself, never opp
+			if (!check_liberty(near, opp)) {
+				here = piece_type::empty;
+				return nogo_move_result::illegal_take;
+			}
+		}
+		attr.who_take_turns = static_cast<piece_type>(opp); // is legal move!
 		return nogo_move_result::legal;
 	}
 	reward place(const point& p, unsigned who = piece_type::unknown) {
@@ -138,41 +157,35 @@ public:
 	}
 
 	int check_place(const point& p){
-		board test = *this;
-		return test[p.x][p.y];
+		return stone[p.x][p.y];
 	}
 
 	/**
-	 * calculate the liberty of the block of piece at [x][y]
-	 * return >= 0 if [x][y] is placed by who; otherwise return -1
+	 * check whether the block of piece at [x][y] has any liberty
+	 * return true if it has, or if [x][y] is not placed by who
 	 */
 	bool check_liberty(int x, int y, unsigned who) const {
-		grid test = stone;
-		if (test[x][y] != who) return true;
-
-		// bool liberty = 0;
-		std::list<point> check;
-		for (check.emplace_back(x, y); check.size(); check.pop_front()) {
-			int x = check.front().x, y = check.front().y;
-			test[x][y] = piece_type::unknown; // prevent recalculate
-
-			point p_min(0, 0), p_max(size_x - 1, size_y - 1);
-
-			cell near_l = x > p_min.x ? test[x - 1][y] : -1u; // left
-			if (near_l == piece_type::empty) return true;
-			else if (near_l == who) check.emplace_back(x - 1, y);
-
-			cell near_r = x < p_max.x ? test[x + 1][y] : -1u; // right
-			if (near_r == piece_type::empty) return true;
-			else if (near_r == who) check.emplace_back(x + 1, y);
-
-			cell near_d = y > p_min.y ? test[x][y - 1] : -1u; // down
-			if (near_d == piece_type::empty) return true;
-			else if (near_d == who) check.emplace_back(x, y - 1);
+		return check_liberty(x * size_y + y, who);
+	}
+	bool check_liberty(int i, unsigned who) const {
+		PROFILE_SCOPE(check_liberty);
+		static_assert(sizeof(grid) == sizeof(cell) * table::points, "the grid should be contiguous");
+		cell test[table::points];
+		std::memcpy(test, &stone, sizeof(test));
+		if (test[i] != who) return true;
 
-			cell near_u = y < p_max.y ? test[x][y + 1] : -1u; // up
-			if (near_u == piece_type::empty) return true;
-			else if (near_u == who) check.emplace_back(x, y + 1);
+		int check[table::points], size = 0; // every point is pushed at most once
+		test[i] = piece_type::unknown; // prevent recalculate
+		check[size++] = i;
+		while (size) {
+			const typename table::adjacent& adj = table::neighbor[check[--size]];
+			for (int near : adj.near) {
+				cell c = test[near];
+				if (c == piece_type::empty) return true;
+				if (c != who) continue;
+				test[near] = piece_type::unknown;
+				check[size++] = near;
+			}
 		}
 		return false;
 	}
@@ -218,8 +231,37 @@ public:
 	void rotate_left() { transpose(); reflect_horizontal(); } // counterclockwise
 	void reverse() { reflect_horizontal(); reflect_vertical(); }
 
+	/**
+	 * the point i after the symmetry s is applied, where bit 0 reflects x,
+	 * bit 1 reflects y, and bit 2 transposes (only for square boards)
+	 */
+	static int transform(int i, unsigned s) {
+		int x = i / size_y, y = i % size_y;
+		if (s & 1) x = size_x - 1 - x;
+		if (s & 2) y = size_y - 1 - y;
+		if (s & 4) std::swap(x, y);
+		return x * size_y + y;
+	}
+	static unsigned symmetries() {
+		return size_x == size_y ? 8 : 4;
+	}
+
+	/**
+	 * the set of the symmetries which leave the position unchanged, with bit s for the symmetry s
+	 * the identity (bit 0) is always included, and the hollow points are compared like the stones
+	 */
+	unsigned stabilizer() const {
+		unsigned stable = 1;
+		for (unsigned s = 1; s < symmetries(); s++) {
+			int i = 0;
+			while (i < size_x * size_y && (*this)(i) == (*this)(transform(i, s))) i++;
+			if (i == size_x * size_y) stable |= 1u << s;
+		}
+		return stable;
+	}
+
 public:
-	friend std::ostream& operator <<(std::ostream& out, const board& b) {
+	friend std::ostream& operator <<(std::ostream& out, const basic_board& b) {
 		std::ios ff(nullptr);
 		ff.copyfmt(out); // make a copy of the original print format
 
@@ -248,7 +290,7 @@ public:
 		out.copyfmt(ff); // restore print format
 		return out;
 	}
-	friend std::istream& operator >>(std::istream& in, board& b) {
+	friend std::istream& operator >>(std::istream& in, basic_board& b) {
 		std::string token;
 		for (int x = 0; x < size_x; x++) in >> token; /* skip X */
 		for (int y = size_y - 1; y >= 0 && in >> token /* skip Y */; in >> token /* skip Y */, y--) {
@@ -279,19 +321,24 @@ public:
 	}
 
 protected:
-	static const grid& initial() { static grid stone; return stone; }
-	static __attribute__((constructor)) void init_initial_scheme() {
-		grid& stone = const_cast<grid&>(initial());
-		stone[4][1] = piece_type::hollow;
-		stone[4][2] = piece_type::hollow;
-		stone[4][6] = piece_type::hollow;
-		stone[4][7] = piece_type::hollow;
-		stone[1][4] = piece_type::hollow;
-		stone[2][4] = piece_type::hollow;
-		stone[6][4] = piece_type::hollow;
-		stone[7][4] = piece_type::hollow;
+	typedef geometry_table<geometry> table;
+
+	static const grid& initial() {
+		static const grid stone = layout();
+		return stone;
 	}
+	static grid layout() {
+		grid stone;
+		for (int i = 0; i < table::points; i++) stone[i / size_y][i % size_y] = table::layout[i];
+		return stone;
+	}
+
 private:
 	grid stone;
 	data attr;
 };
+
+#ifndef NOGO_GEOMETRY
+#define NOGO_GEOMETRY hollow9
+#endif
+typedef basic_board<NOGO_GEOMETRY> board;
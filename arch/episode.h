@@ -20,8 +20,9 @@
 #include "agent.h"
 
 class episode {
+	friend class game_record;
 public:
-	episode() : ep_state(initial_state()), ep_score(0), ep_time(0) {
+	episode() : ep_state(initial_state()), ep_score(0), ep_time(0), ep_time_by({ 0, 0 }) {
 		ep_moves.reserve(board::size_x * board::size_y);
 	}
 
@@ -36,10 +37,11 @@ public:
 	void close_episode(const std::string& tag) {
 		ep_close = { tag, millisec() };
 	}
-	bool apply_action(action move) {
+	bool apply_action(placement move) {
 		board::reward reward = move.apply(state());
 		if (reward != board::legal) return false;
 		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		ep_time_by[(ep_moves.size() - 1) % 2] += ep_moves.back().time;
 		ep_score += reward;
 		return true;
 	}
@@ -69,11 +71,11 @@ public:
 		switch (who) {
 		case board::black:
 		case action::black::type:
-			for (size_t i = 0; i < ep_moves.size(); i += 2) time += ep_moves[i].time;
+			time = ep_time_by[0];
 			break;
 		case board::white:
 		case action::white::type:
-			for (size_t i = 1; i < ep_moves.size(); i += 2) time += ep_moves[i].time;
+			time = ep_time_by[1];
 			break;
 		case action::place::type:
 		default:
@@ -102,6 +104,12 @@ public:
 		return res;
 	}
 
+	/**
+	 * the time taken by the i-th move, and the players as "black:white"
+	 */
+	time_t move_time(size_t i) const { return ep_moves[i].time; }
+	const std::string& players() const { return ep_open.tag; }
+
 public:
 
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
@@ -140,6 +148,7 @@ public:
 				ss >> ep.ep_moves.back();
 			}
 			ep.ep_score = 0;
+			ep.recount();
 		} else {
 			in.setstate(std::ios::failbit);
 		}
@@ -149,19 +158,21 @@ public:
 protected:
 
 	struct move {
-		action code;
+		placement code;
 		board::reward reward;
 		time_t time;
-		move(action code = {}, board::reward reward = 0, time_t time = 0) : code(code), reward(reward), time(time) {}
+		move(placement code = action(), board::reward reward = 0, time_t time = 0) : code(code), reward(reward), time(time) {}
 
 		operator action() const { return code; }
 		friend std::ostream& operator <<(std::ostream& out, const move& m) {
-			out << m.code;
+			out << action(m.code);
 			if (m.time) out << "C[" << std::dec << m.time << "]";
 			return out;
 		}
 		friend std::istream& operator >>(std::istream& in, move& m) {
-			in >> m.code;
+			action code;
+			in >> code;
+			m.code = code;
 			m.reward = 0;
 			m.time = 0;
 			if (in.peek() == 'C') {
@@ -186,6 +197,14 @@ protected:
 		}
 	};
 
+	/**
+	 * rebuild the time of each side after the moves are loaded
+	 */
+	void recount() {
+		ep_time_by = { 0, 0 };
+		for (size_t i = 0; i < ep_moves.size(); i++) ep_time_by[i % 2] += ep_moves[i].time;
+	}
+
 	static board initial_state() {
 		return {};
 	}
@@ -199,6 +218,7 @@ private:
 	board::score ep_score;
 	std::vector<move> ep_moves;
 	time_t ep_time;
+	std::array<time_t, 2> ep_time_by; // the total time of black and white
 
 	meta ep_open;
 	meta ep_close;
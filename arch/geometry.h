@@ -0,0 +1,79 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * geometry.h: Compile-time board geometries and their constexpr layout and neighbor tables
+ *
+ * a geometry defines size_x, size_y, and whether each point is hollow, e.g.,
+ *   plain7   7x7 NoGo
+ *   hollow9  9x9 Hollow NoGo (the default board)
+ *   plain9   9x9 NoGo
+ *   plain11  11x11 NoGo
+ * the tables are generated from the geometry while compiling, and the neighbors which are
+ * out of the board point back to the point itself, so the inner loops need no bounds checks
+ */
+
+#pragma once
+#include <cstdint>
+
+template<unsigned x, unsigned y>
+struct plain_geometry {
+	enum { size_x = x, size_y = y };
+	static constexpr bool hollow(int i) { return false; }
+};
+
+struct hollow9 : plain_geometry<9, 9> {
+	/**
+	 * the plus-shaped hollow points, i.e., B5, C5, G5, H5, E2, E3, E7, E8
+	 */
+	static constexpr bool hollow(int i) {
+		return (i / 9 == 4 && (i % 9 == 1 || i % 9 == 2 || i % 9 == 6 || i % 9 == 7))
+		    || (i % 9 == 4 && (i / 9 == 1 || i / 9 == 2 || i / 9 == 6 || i / 9 == 7));
+	}
+};
+
+typedef plain_geometry<7, 7> plain7;
+typedef plain_geometry<9, 9> plain9;
+typedef plain_geometry<11, 11> plain11;
+
+/**
+ * integer sequence 0, 1, ..., n - 1 for expanding the tables (std::index_sequence is C++14)
+ */
+template<int... i> struct index_sequence {};
+template<int n, int... i> struct make_index_sequence : make_index_sequence<n - 1, n - 1, i...> {};
+template<int... i> struct make_index_sequence<0, i...> { typedef index_sequence<i...> type; };
+
+template<class geometry>
+struct geometry_rules {
+	enum { size_x = geometry::size_x, size_y = geometry::size_y, points = size_x * size_y };
+
+	/**
+	 * the left, right, down, and up neighbors of a point, or the point itself if out of the board
+	 */
+	struct adjacent {
+		int near[4];
+	};
+
+	static constexpr int left(int i) { return i / size_y > 0 ? i - size_y : i; }
+	static constexpr int right(int i) { return i / size_y < size_x - 1 ? i + size_y : i; }
+	static constexpr int down(int i) { return i % size_y > 0 ? i - 1 : i; }
+	static constexpr int up(int i) { return i % size_y < size_y - 1 ? i + 1 : i; }
+	static constexpr adjacent neighbor_of(int i) { return adjacent{ { left(i), right(i), down(i), up(i) } }; }
+	static constexpr uint32_t layout_of(int i) { return geometry::hollow(i) ? 3u : 0u; }
+};
+
+/**
+ * the neighbor table and the initial layout (0 for empty, 3 for hollow) of every point
+ */
+template<class geometry, class sequence = typename make_index_sequence<geometry::size_x * geometry::size_y>::type>
+struct geometry_table;
+
+template<class geometry, int... i>
+struct geometry_table<geometry, index_sequence<i...>> : geometry_rules<geometry> {
+	typedef geometry_rules<geometry> rules;
+	static constexpr typename rules::adjacent neighbor[sizeof...(i)] = { rules::neighbor_of(i)... };
+	static constexpr uint32_t layout[sizeof...(i)] = { rules::layout_of(i)... };
+};
+
+template<class geometry, int... i>
+constexpr typename geometry_rules<geometry>::adjacent geometry_table<geometry, index_sequence<i...>>::neighbor[sizeof...(i)];
+template<class geometry, int... i>
+constexpr uint32_t geometry_table<geometry, index_sequence<i...>>::layout[sizeof...(i)];
@@ -0,0 +1,148 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * latency.h: Fixed-bucket latency histograms of the moves and their tail percentiles
+ *
+ * the buckets follow the HDR histogram layout with 3 significant bits, i.e., the values
+ * below 16 milliseconds have their own buckets and every power of two above is split into
+ * 8 buckets, so any recorded value is at most 1/8 off while the histogram has a fixed size
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include "episode.h"
+
+class histogram {
+public:
+	enum { linear = 16, sub = 8, bucket_count = linear + sub * 48 };
+
+	histogram() : total(0), most(0) { bucket.fill(0); }
+
+	void record(uint64_t v) {
+		bucket[index(v)]++;
+		total++;
+		most = std::max(most, v);
+	}
+
+	uint64_t count() const { return total; }
+	uint64_t max() const { return most; }
+
+	/**
+	 * the highest value of the bucket where the given quantile falls, clipped by the maximum
+	 */
+	uint64_t percentile(double q) const {
+		if (total == 0) return 0;
+		uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total + 0.999999));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < bucket.size(); i++) {
+			seen += bucket[i];
+			if (seen >= rank) return std::min(upper(i), most);
+		}
+		return most;
+	}
+
+	histogram& operator +=(const histogram& h) {
+		for (size_t i = 0; i < bucket.size(); i++) bucket[i] += h.bucket[i];
+		total += h.total;
+		most = std::max(most, h.most);
+		return *this;
+	}
+
+	/**
+	 * the nonempty buckets as "count=N max=M buckets=lower:count,lower:count,..."
+	 */
+	friend std::ostream& operator <<(std::ostream& out, const histogram& h) {
+		out << "count=" << h.total << " max=" << h.most << " buckets=";
+		bool first = true;
+		for (size_t i = 0; i < h.bucket.size(); i++) {
+			if (h.bucket[i] == 0) continue;
+			out << (first ? "" : ",") << lower(i) << ":" << h.bucket[i];
+			first = false;
+		}
+		return out;
+	}
+
+protected:
+	static size_t index(uint64_t v) {
+		if (v < linear) return v;
+		int m = 63 - __builtin_clzll(v); // m >= 4
+		size_t i = linear + (m - 4) * sub + ((v >> (m - 3)) & (sub - 1));
+		return std::min<size_t>(i, bucket_count - 1);
+	}
+	static uint64_t lower(size_t i) {
+		if (i < linear) return i;
+		int m = 4 + (i - linear) / sub;
+		return uint64_t(sub + (i - linear) % sub) << (m - 3);
+	}
+	static uint64_t upper(size_t i) {
+		return i + 1 < bucket_count ? lower(i + 1) - 1 : UINT64_MAX;
+	}
+
+private:
+	std::array<uint64_t, bucket_count> bucket;
+	uint64_t total;
+	uint64_t most;
+};
+
+/**
+ * the move latency of every agent, split into game phases by the move number
+ * agents are keyed as "black:name" and "white:name" after the open tag of the episodes
+ */
+class latency {
+public:
+	enum phase { opening, middle, endgame, phase_count };
+
+	static phase phase_of(size_t ply) {
+		return ply < 20 ? opening : ply < 50 ? middle : endgame;
+	}
+
+	void account(const episode& ep) {
+		std::string names = ep.players();
+		size_t split = names.find(':');
+		std::string name[] = { names.substr(0, split), split != std::string::npos ? names.substr(split + 1) : "" };
+		std::array<histogram, phase_count>* agent[] = { &table["black:" + name[0]], &table["white:" + name[1]] };
+		for (size_t i = 0; i < ep.step(); i++) {
+			(*agent[i % 2])[phase_of(i)].record(ep.move_time(i));
+		}
+	}
+
+	/**
+	 * one line per agent with p50/p90/p99/max of each phase, in milliseconds
+	 */
+	void show(std::ostream& out = std::cout) const {
+		for (const auto& agent : table) {
+			out << "\t" << agent.first << ":";
+			for (size_t p = 0; p < phase_count; p++) {
+				const histogram& h = agent.second[p];
+				out << " " << names()[p] << " = " << h.percentile(0.5) << "|" << h.percentile(0.9)
+				    << "|" << h.percentile(0.99) << "|" << h.max() << (p + 1 < phase_count ? "," : "");
+			}
+			out << std::endl;
+		}
+	}
+
+	/**
+	 * the histograms in text, one line per agent and phase
+	 */
+	friend std::ostream& operator <<(std::ostream& out, const latency& lat) {
+		for (const auto& agent : lat.table) {
+			for (size_t p = 0; p < phase_count; p++) {
+				out << agent.first << " " << names()[p] << " " << agent.second[p] << std::endl;
+			}
+		}
+		return out;
+	}
+
+protected:
+	static const char** names() {
+		static const char* name[] = { "opening", "middle", "endgame" };
+		return name;
+	}
+
+private:
+	std::map<std::string, std::array<histogram, phase_count>> table;
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include "struct.h"
 
 
@@ -6,44 +8,97 @@ class compare{
 public:
 	compare(){}
 public:
-	virtual bool compare_result(const int& bas){return true;}
+	virtual bool compare_result(const int& bas, const node* root){return true;}
 	virtual void new_game(){}
+	virtual std::string reason() const {return "done";}
 };
 
+/**
+ * stop at the deadline, or earlier when the most visited child of the root cannot be overtaken
+ * by the runner-up within the remaining simulations; when the top two are still close at the
+ * deadline, the search is extended once, up to the hard limit
+ */
 class time_compare : public compare{
 public:
-	time_compare(const uint64_t& limit_range, const int& game_step) : compare(), game_step(0), time_limit_(limit_range){
+	time_compare(const uint64_t& limit_range, const int& game_step, const uint64_t& hard_limit = 0, const bool& adaptive = true) : compare(), game_step(0),
+		time_start_(millisec()), time_limit_(limit_range), hard_limit_(std::max(hard_limit, limit_range)), adaptive_(adaptive), extended_(false), reason_("none"){
 		// time_limit_ = millisec() + setup_time(limit_range, game_step);
 	}
 public:
-	virtual bool compare_result(const int& simulation_counts){
-		if(simulation_counts%500 != 0) return false;
-		if(millisec() > time_limit_){
+	virtual bool compare_result(const int& simulation_counts, const node* root){
+		if(simulation_counts%check_interval != 0) return false;
+		uint64_t now = millisec();
+		if(!adaptive_ || root->available_node_count <= 0) return now > time_limit_ && stop_for("deadline");
+
+		// only the own visits, since remain covers only this thread while the others keep adding to the merged counts
+		double best = 0, second = 0;
+		for(const node* n : root->level_vector){
+			if(n->own_visits() > best){
+				second = best;
+				best = n->own_visits();
+			}else if(n->own_visits() > second){
+				second = n->own_visits();
+			}
+		}
+		if(now > time_limit_){
+			if(extended_ || hard_limit_ <= time_limit_ || second < best * close_ratio) return stop_for(extended_ ? "extended" : "deadline");
+			extended_ = true; // too close to call, spend some of the reserve
+			time_limit_ = std::min(hard_limit_, time_limit_ + (time_limit_ - time_start_) / 2);
+			return false;
+		}
+		double rate = simulation_counts / double(std::max<uint64_t>(now - time_start_, 1));
+		double remain = rate * (time_limit_ - now);
+		if(best - second > remain){
 			game_step++;
-			return true;
+			return stop_for("decided");
 		}
 		return false;
 	}
+	virtual std::string reason() const {return reason_;}
 	int setup_time(const int& limit_range, const int& game_step){
 		return (2-0.05*game_step)*limit_range;
 	}
 
-	uint64_t millisec() {
-		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	static uint64_t millisec() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+protected:
+	bool stop_for(const char* reason){
+		reason_ = reason;
+		return true;
 	}
 private:
+	static constexpr int check_interval = 64;
+	static constexpr double close_ratio = 0.9;
+
 	int game_step;
+	uint64_t time_start_;
 	uint64_t time_limit_;
+	uint64_t hard_limit_;
+	bool adaptive_;
+	bool extended_;
+	const char* reason_;
 };
 
 class count_compare : public compare{
 public:
 	count_compare(const int& count_limit) : compare(), count_limit_(count_limit){}
 public:
-	virtual bool compare_result(const int& count){
+	virtual bool compare_result(const int& count, const node* root){
 		if(count == count_limit_) return true;
 		return false;
 	}
+	virtual std::string reason() const {return "count";}
 private:
 	int count_limit_;
 };
+
+class ponder_compare : public compare{
+public:
+	ponder_compare() : compare(){}
+public:
+	virtual bool compare_result(const int& count, const node* root){
+		return false; // never stop by itself, the owner raises the stop flag instead
+	}
+	virtual std::string reason() const {return "stopped";}
+};
@@ -1,60 +1,149 @@
 #pragma once
+#include <climits>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "mcts_compare.h"
 
 class mcts_tree{
 public:
-	mcts_tree(const board::piece_type& who, const float c) : who_(who),
+	mcts_tree(const board::piece_type& who, const float c) : stats_(nullptr), mem_limit_(0), own_bytes_(false), tree_bytes_(0), symmetric_(false), who_(who),
 		c_(0.3){
 		if (c != 0.3) c_ = c;
     }
 
 
 	void MCTS_simulate(node* root, board& after){
-		node* leaf = Selection_Expansion(root, after);
-		board::piece_type losser = Rollout(leaf, after);
-		Backpropagation(losser);
+		if(stats_) return MCTS_simulate_timed(root, after);
+		node* leaf;
+		board::piece_type losser;
+		{ PROFILE_SCOPE(selection_expansion); leaf = Selection_Expansion(root, after); }
+		{ PROFILE_SCOPE(rollout); losser = Rollout(leaf, after); }
+		{ PROFILE_SCOPE(backpropagation); Backpropagation(losser); }
+	}
+
+	/**
+	 * the same simulation, but the time of each phase and the depth are recorded in stats_
+	 */
+	void MCTS_simulate_timed(node* root, board& after){
+		int64_t expansion = stats_->expansion_ns;
+		node* leaf;
+		board::piece_type losser;
+		int64_t t0 = nanosec();
+		{ PROFILE_SCOPE(selection_expansion); leaf = Selection_Expansion(root, after); }
+		int64_t t1 = nanosec();
+		{ PROFILE_SCOPE(rollout); losser = Rollout(leaf, after); }
+		int64_t t2 = nanosec();
+		int depth = update_path.size() - 1;
+		{ PROFILE_SCOPE(backpropagation); Backpropagation(losser); }
+		int64_t t3 = nanosec();
+		stats_->selection_ns += (t1 - t0) - (stats_->expansion_ns - expansion);
+		stats_->rollout_ns += t2 - t1;
+		stats_->backprop_ns += t3 - t2;
+		stats_->max_depth = std::max(stats_->max_depth, depth);
+		stats_->depth_sum += depth;
 	}
 
     node* Selection_Expansion(node* root, board& state, int state_flag=1){
-		update_node_vector.push_back(root);
+		if(update_path.empty()) update_path.emplace_back(root, -1);
 		if(root->available_node_count == -1){
-			root->level_vec_init(state);
+			// over the memory cap, the leaves stay leaves and the tree above them keeps being refined
+			if(mem_limit_ && update_path.size() > 1 && used() >= mem_limit_) return root;
+			int64_t start = stats_ ? nanosec() : 0;
+			root->level_vec_init(state, symmetric_);
 			std::shuffle(root->level_vector.begin(), root->level_vector.end(), engine);
+			if(own_bytes_) tree_bytes_ += root->level_bytes();
+			if(stats_){
+				stats_->expansion_ns += nanosec() - start;
+				stats_->nodes += root->level_vector.size();
+				stats_->bytes += root->level_bytes();
+			}
 		}
 		if(root->available_node_count==0) return root;
-		double max_uct = -2;
-		double uct;
-		int max_uct_idx = -1;
-		for(int i=0;i<root->level_vector.size();i++){
-			if(root->level_vector[i]->visit_count == 0){
-				state.place(root->level_vector[i]->move_position);
-				update_node_vector.push_back(root->level_vector[i]);
-				return root->level_vector[i];
-			}else{
-				uct = get_Q(root, i);
-				if(max_uct < uct){
-					max_uct = uct;
-					max_uct_idx = i;
-				}
+		int idx = Select(root);
+		node* child = root->level_vector[idx];
+		state.place_at(child->move_position);
+		update_path.emplace_back(root, idx);
+		if(root->child_visits()[idx] == 0) return child;
+		return Selection_Expansion(child, state, state_flag*-1);
+    }
+
+	/**
+	 * the child with the highest UCT score w/n + c*sqrt(log(N)/n), or the first unvisited one,
+	 * the ties go to the first child; the parent term c*sqrt(log(N)) is computed once per node
+	 */
+	int Select(const node* n) const{
+#ifdef __SSE2__
+		return select_sse2(n, c_);
+#else
+		return select_scalar(n, c_);
+#endif
+	}
+
+	/**
+	 * the selection one child at a time, for the builds without SSE2 and as the reference of the SSE2 one
+	 */
+	static int select_scalar(const node* n, const float& c){
+		const size_t stride = n->stride();
+		const float* wins = n->child_wins();
+		const float* visits = n->child_visits();
+		const float parent = c * uct_table::sqrt_log(n->visit_count);
+		int choice = 0;
+		float best = -INFINITY;
+		for(size_t i=0;i<stride;i++){
+			if(visits[i] == 0) return i;
+			float score = wins[i] / visits[i] + parent * uct_table::inv_sqrt(visits[i]);
+			if(best < score){
+				best = score;
+				choice = i;
 			}
 		}
-		state.place(root->level_vector[max_uct_idx]->move_position);
-		return Selection_Expansion(root->level_vector[max_uct_idx], state, state_flag*-1);
-    }	
+		return choice;
+	}
 
-	double get_Q(const node* n, const int& idx){
-		// other function uct2
-		return (n->level_vector[idx]->win_count/n->level_vector[idx]->visit_count)+c_*sqrt(log(n->visit_count)/n->level_vector[idx]->visit_count);
+#ifdef __SSE2__
+	/**
+	 * the selection four children at a time, with a per-lane argmax which keeps the ties on the first child
+	 */
+	static int select_sse2(const node* n, const float& c){
+		const size_t stride = n->stride();
+		const float* wins = n->child_wins();
+		const float* visits = n->child_visits();
+		const float parent = c * uct_table::sqrt_log(n->visit_count);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), four = _mm_set1_ps(4);
+		const __m128 unseen = _mm_set1_ps(INFINITY), k = _mm_set1_ps(parent);
+		__m128 best = _mm_set1_ps(-INFINITY), best_idx = zero, idx = _mm_set_ps(3, 2, 1, 0);
+		for(size_t i=0;i<stride;i+=4){
+			__m128 w = _mm_loadu_ps(wins + i), v = _mm_loadu_ps(visits + i);
+			__m128 fresh = _mm_cmpeq_ps(v, zero);
+			v = _mm_or_ps(_mm_and_ps(fresh, one), _mm_andnot_ps(fresh, v));
+			__m128 score = _mm_add_ps(_mm_div_ps(w, v), _mm_div_ps(k, _mm_sqrt_ps(v)));
+			score = _mm_or_ps(_mm_and_ps(fresh, unseen), _mm_andnot_ps(fresh, score));
+			__m128 better = _mm_cmpgt_ps(score, best);
+			best = _mm_or_ps(_mm_and_ps(better, score), _mm_andnot_ps(better, best));
+			best_idx = _mm_or_ps(_mm_and_ps(better, idx), _mm_andnot_ps(better, best_idx));
+			idx = _mm_add_ps(idx, four);
+		}
+		float lane_best[4], lane_idx[4];
+		_mm_storeu_ps(lane_best, best);
+		_mm_storeu_ps(lane_idx, best_idx);
+		int choice = 0;
+		for(int l=1;l<4;l++){
+			if(lane_best[l] > lane_best[choice] || (lane_best[l] == lane_best[choice] && lane_idx[l] < lane_idx[choice])) choice = l;
+		}
+		return int(lane_idx[choice]);
 	}
-	
+#endif
+
 	board::piece_type Rollout(node* root, board&state){
 		std::vector<int> tmp = root->empty_vector;
 		std::shuffle(tmp.begin(), tmp.end(), engine);
 		int move_count = tmp.size()-1;
 		for(int i=0;i<tmp.size();i++){
-			if(state.place(tmp[i]) == board::legal){
+			if(state.place_at(tmp[i]) == board::legal){
 				for(;move_count>=0;move_count--){
-					if(state.place(tmp[move_count]) == board::legal){						
+					if(state.place_at(tmp[move_count]) == board::legal){						
 						break;
 					}
 				}
@@ -66,49 +155,314 @@ public:
 
 	void Backpropagation(board::piece_type losser){
 		int win_value = who_ == losser ? 0 : 1;
-        for(auto update_node : update_node_vector){
+		for(auto step : update_path){ // the root, then (parent, index of the child)
+			node* update_node = step.second < 0 ? step.first : step.first->level_vector[step.second];
 			update_node->visit_count += 1;
 			update_node->win_count += win_value;
+			if(step.second < 0) continue;
+			step.first->child_visits()[step.second] += 1;
+			step.first->child_wins()[step.second] += win_value;
 		}
-		update_node_vector.clear();
+		update_path.clear();
     }
+	/**
+	 * collapse the least visited subtrees of this tree until the nodes of the process fit in 3/4 of the cap
+	 * the deeper nodes go first among the equally visited ones, and a node under an already collapsed
+	 * ancestor is skipped, since the counts merged by sync_board may rank a child above its parent
+	 */
+	void Recycle(node* root){
+		// every expanded node with the index of its expanded parent (-1 under the root), the parents come first
+		std::vector<std::pair<node*, int>> expanded, open = { { root, -1 } };
+		std::vector<int> depth;
+		while(open.size()){
+			std::pair<node*, int> n = open.back();
+			open.pop_back();
+			for(auto child : n.first->level_vector){
+				if(child->level_vector.empty()) continue;
+				depth.push_back(n.second < 0 ? 1 : depth[n.second] + 1);
+				expanded.emplace_back(child, n.second);
+				open.emplace_back(child, int(expanded.size()) - 1);
+			}
+		}
+		std::vector<int> order(expanded.size());
+		for(size_t i=0;i<order.size();i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](const int& a, const int& b){
+			double va = expanded[a].first->visit_count, vb = expanded[b].first->visit_count;
+			return va != vb ? va < vb : depth[a] > depth[b];
+		});
+		std::vector<bool> collapsed(expanded.size(), false);
+		for(int i : order){
+			if(used() <= mem_limit_ / 4 * 3) break;
+			bool freed = false;
+			for(int p = expanded[i].second; p >= 0 && !freed; p = expanded[p].second) freed = collapsed[p];
+			if(freed) continue;
+			node* n = expanded[i].first;
+			int64_t before = own_bytes_ ? subtree_bytes(n) : 0;
+			n->collapse();
+			if(own_bytes_) tree_bytes_ -= before - n->bytes();
+			collapsed[i] = true;
+		}
+	}
+
+	/**
+	 * the bytes counted against the memory cap, of this tree only or of all the nodes in the process
+	 */
+	int64_t used() const{
+		return own_bytes_ ? tree_bytes_ : node_bytes().load(std::memory_order_relaxed);
+	}
+
+	static int64_t subtree_bytes(const node* n){
+		int64_t bytes = n->bytes();
+		for(auto child : n->level_vector) bytes += subtree_bytes(child);
+		return bytes;
+	}
+
+	static int64_t nanosec(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 protected:
 	std::default_random_engine engine;
+	search_stats* stats_;
+	int64_t mem_limit_;
+	bool own_bytes_;
+	int64_t tree_bytes_;
+	bool symmetric_;
 
 private:
 	board::piece_type who_;
-	std::vector<node*> update_node_vector;
+	std::vector<std::pair<node*, int>> update_path;
 	double c_;
 };
 
 class mcts_management : public mcts_tree{
 public:
-    mcts_management(const board::piece_type& who, const int& gs, const int& tsc, const uint64_t& tst, const uint64_t& limitt, const float& c) : mcts_tree(who, c), total_simulation_count_(100), total_simulation_time_(10005){
+    mcts_management(const board::piece_type& who, const int& gs, const int& tsc, const uint64_t& tst, const uint64_t& limitt, const float& c) : mcts_tree(who, c), total_simulation_count_(100), total_simulation_time_(10005), stop_(nullptr), analysis_(nullptr), slot_(0), publish_interval_(0), sync_(nullptr), sync_slot_(0), simulation_count_(0), published_(0), recycle_(false){
 	if (tsc != 100) total_simulation_count_ = tsc;
 	if (tst != 277){
 		total_simulation_time_ = tst;
-		rule = new time_compare(limitt, gs);
+		rule = std::make_shared<time_compare>(limitt, gs);
 	}else{
-		rule = new count_compare(total_simulation_count_);
+		rule = std::make_shared<count_compare>(total_simulation_count_);
 	}
 	engine.seed(std::chrono::system_clock::now().time_since_epoch().count());
     }
 
+	/**
+	 * search until the given deadline regardless of T, which may be stopped early or extended
+	 * up to the hard limit when adaptive
+	 */
+	mcts_management& timed(const uint64_t& limit, const uint64_t& hard_limit, const int& gs, const bool& adaptive){
+		rule = std::make_shared<time_compare>(limit, gs, hard_limit, adaptive);
+		return *this;
+	}
+
+	/**
+	 * collect the telemetry of this search into the given stats
+	 */
+	mcts_management& report(search_stats* stats){
+		stats_ = stats;
+		return *this;
+	}
+
+	/**
+	 * publish the root summary into the given slot of the analysis board every interval milliseconds
+	 */
+	mcts_management& publish(analysis_board* board, const int& slot, const int& interval){
+		analysis_ = board;
+		slot_ = slot;
+		publish_interval_ = interval;
+		return *this;
+	}
+
+	/**
+	 * the children of the root with their principal variations, following the most visited child
+	 */
+	static std::vector<root_summary> summarize(const node* root, const size_t& pv_length = 10){
+		std::vector<root_summary> summary;
+		for(const node* child : root->level_vector){
+			if(child->own_visits() == 0) continue;
+			root_summary s = { child->move_position, child->own_visits(), child->own_wins(), { child->move_position } };
+			for(const node* n = child; s.pv.size() < pv_length; ){
+				const node* next = nullptr;
+				for(const node* c : n->level_vector){
+					if(c->visit_count > 0 && (!next || c->visit_count > next->visit_count)) next = c;
+				}
+				if(!next) break;
+				s.pv.push_back(next->move_position);
+				n = next;
+			}
+			summary.push_back(s);
+		}
+		return summary;
+	}
+
+	/**
+	 * search without any budget until the stop flag is raised by the owner,
+	 * used for pondering on the opponent's time
+	 */
+	mcts_management& ponder(const std::atomic<bool>* stop){
+		rule = std::make_shared<ponder_compare>();
+		stop_ = stop;
+		return *this;
+	}
+
+	/**
+	 * cap the bytes of the nodes in the process, or of this tree only if own, see Selection_Expansion and Recycle
+	 * the cap of the process depends on the other searches, while the cap of a tree is reproducible
+	 */
+	mcts_management& memory(const int64_t& limit, const bool& own = false){
+		mem_limit_ = limit;
+		own_bytes_ = own;
+		return *this;
+	}
+
+	/**
+	 * expand only one move of every set of moves which are equivalent under the symmetries of the position
+	 */
+	mcts_management& symmetry(const bool& on){
+		symmetric_ = on;
+		return *this;
+	}
+
+	/**
+	 * stop after the given count of simulations regardless of T
+	 */
+	mcts_management& counted(const int& count){
+		rule = std::make_shared<count_compare>(count);
+		return *this;
+	}
+
+	/**
+	 * seed the random engine instead of using the clock, for reproducible searches
+	 */
+	mcts_management& seed(const uint64_t& seed){
+		engine.seed(seed);
+		return *this;
+	}
+
+	/**
+	 * also stop as soon as the given flag is raised by the owner
+	 */
+	mcts_management& interrupt(const std::atomic<bool>* stop){
+		stop_ = stop;
+		return *this;
+	}
+
+	/**
+	 * exchange the root and shallow statistics with the other threads through the given slot every interval simulations
+	 */
+	mcts_management& synchronize(sync_board* board, const int& slot){
+		sync_ = board;
+		sync_slot_ = slot;
+		return *this;
+	}
+
+	/**
+	 * publish the own statistics of the root children and their children, and take over the sums of
+	 * the other threads on top of them, so the selection continues as if the trees were merged
+	 */
+	void Synchronize(node* root){
+		double root_visits = 0, root_wins = 0;
+		for(size_t i=0;i<root->level_vector.size();i++){
+			node* child = root->level_vector[i];
+			double visits = child->shared_visits, wins = child->shared_wins;
+			exchange(sync_board::key(child->move_position), root, i);
+			root_visits += child->shared_visits - visits;
+			root_wins += child->shared_wins - wins;
+			for(size_t j=0;j<child->level_vector.size();j++){
+				exchange(sync_board::key(child->move_position, child->level_vector[j]->move_position), child, j);
+			}
+		}
+		root->visit_count += root_visits;
+		root->win_count += root_wins;
+		root->shared_visits += root_visits;
+		root->shared_wins += root_wins;
+	}
+
     void operator()(const board& state, node* root){
+		begin(root);
+		while(!advance(state, root, INT_MAX));
+		finish();
+    }
+
+	/**
+	 * prepare a search of the root which is run by advance(), possibly in chunks on different threads
+	 */
+	void begin(node* root){
+		simulation_count_ = 0;
+		published_ = time_compare::millisec();
+		recycle_ = mem_limit_ > 0;
+		if(mem_limit_ && own_bytes_) tree_bytes_ = subtree_bytes(root);
+	}
+
+	/**
+	 * run at most budget simulations, and return true once the search is over
+	 */
+	bool advance(const board& state, node* root, const int& budget){
 		board after;
-		int simulation_count=0;
-		// MCTS 
-		while(true){
+		bool over = false;
+		for(int n=0;n<budget && !over;n++){
 			after = state;
 			MCTS_simulate(root, after);
-			simulation_count++;
-			if(rule->compare_result(simulation_count)) break;
+			simulation_count_++;
+			if(analysis_ && simulation_count_%128 == 0 && time_compare::millisec() - published_ >= uint64_t(publish_interval_)){
+				std::vector<root_summary> summary = summarize(root);
+				std::lock_guard<std::mutex> guard(analysis_->lock);
+				analysis_->slots[slot_].swap(summary);
+				published_ = time_compare::millisec();
+			}
+			if(sync_ && simulation_count_%sync_->interval == 0) Synchronize(root);
+			if(recycle_ && simulation_count_%64 == 0 && used() >= mem_limit_){
+				Recycle(root);
+				recycle_ = used() < mem_limit_; // the rest belongs to other trees, only stop expanding
+			}
+			over = rule->compare_result(simulation_count_, root) || (stop_ && stop_->load(std::memory_order_relaxed));
 		}
-		std::cout << simulation_count << std::endl;
-    }
+		PROFILE_FLUSH();
+		return over;
+	}
+
+	void finish(){
+		if(stats_){
+			stats_->simulations = simulation_count_;
+			stats_->stop = stop_ && stop_->load() ? "stopped" : rule->reason();
+		}
+	}
     
 private:
 	float total_simulation_count_;
 	int total_simulation_time_;
-	compare* rule;
+	std::shared_ptr<compare> rule;
+	const std::atomic<bool>* stop_;
+	analysis_board* analysis_;
+	int slot_;
+	int publish_interval_;
+	sync_board* sync_;
+	int sync_slot_;
+	int simulation_count_;
+	uint64_t published_;
+	bool recycle_;
+
+	/**
+	 * publish the own counts of the i-th child of the parent, and replace its shared part with the sum of the other threads
+	 */
+	void exchange(const int& key, node* parent, const size_t& i){
+		node* n = parent->level_vector[i];
+		sync_board::entry& own = sync_->slots[sync_slot_][key];
+		own.visits.store(int32_t(n->own_visits()), std::memory_order_relaxed);
+		own.wins.store(int32_t(n->own_wins()), std::memory_order_relaxed);
+		double visits = 0, wins = 0;
+		for(size_t t=0;t<sync_->slots.size();t++){
+			if(int(t) == sync_slot_) continue;
+			visits += sync_->slots[t][key].visits.load(std::memory_order_relaxed);
+			wins += sync_->slots[t][key].wins.load(std::memory_order_relaxed);
+		}
+		double dv = visits - n->shared_visits, dw = wins - n->shared_wins;
+		n->visit_count += dv;
+		n->win_count += dw;
+		n->shared_visits = visits;
+		n->shared_wins = wins;
+		parent->child_visits()[i] += dv;
+		parent->child_wins()[i] += dw;
+	}
 };
\ No newline at end of file
@@ -7,7 +7,11 @@
 // #include <type_traits>
 // #include <algorithm>
 // #include <ctime>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include "../board.h"
 #include "../action.h"
 #include "../agent.h"
@@ -15,33 +19,258 @@
 
 
 
+/**
+ * the bytes of all the nodes alive in the process, checked against the memory cap of the searches
+ * they are counted only after a player with a memory cap turned the counting on, before it built any tree,
+ * and once per expansion or deletion of a subtree instead of once per node
+ */
+inline std::atomic<int64_t>& node_bytes(){
+    static std::atomic<int64_t> bytes(0);
+    return bytes;
+}
+inline std::atomic<bool>& node_bytes_counted(){
+    static std::atomic<bool> counted(false);
+    return counted;
+}
+inline void count_node_bytes(const int64_t& bytes){
+    if(node_bytes_counted().load(std::memory_order_relaxed)) node_bytes().fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * sqrt(log(n)) and 1/sqrt(n) of the small visit counts for the UCT scores
+ */
+class uct_table{
+public:
+    enum { size = 4096 };
+    static float sqrt_log(const double& n){
+        return n < size ? table().sqrt_log[int(n)] : std::sqrt(std::log(n));
+    }
+    static float inv_sqrt(const float& n){
+        return n < size ? table().inv_sqrt[int(n)] : 1 / std::sqrt(n);
+    }
+protected:
+    struct tables{
+        float sqrt_log[size];
+        float inv_sqrt[size];
+        tables(){
+            for(int n=0;n<size;n++){
+                sqrt_log[n] = n > 1 ? std::sqrt(std::log(n)) : 0;
+                inv_sqrt[n] = n > 0 ? 1 / std::sqrt(n) : 0;
+            }
+        }
+    };
+    static const tables& table(){ static tables t; return t; }
+};
+
 struct node{
     int move_position;
     double win_count;
     double visit_count;
+    // the part of the counts above taken over from the other search threads, see sync_board
+    double shared_wins;
+    double shared_visits;
     int available_node_count;
     std::vector<node*> level_vector;
     std::vector<int> empty_vector;
-    node() : win_count(0), visit_count(0), available_node_count(-1){}
-    node(std::vector<int> inp) : win_count(0), visit_count(0), available_node_count(-1), empty_vector(inp){}
-    node(const board& b) : win_count(0), visit_count(0), available_node_count(-1){
-        for(int i=0;i<81;i++){
-			if(b[i/9][i%9] == 0) empty_vector.push_back(i);
+    // the win counts and then the visit counts of the children, a copy of their own counts laid out
+    // for the SIMD selection, each part is padded to a multiple of 4 with children that never win
+    std::vector<float> child_stats;
+    // the children are counted by the level_vec_init of their parent, and only the roots by themselves
+    node() : win_count(0), visit_count(0), shared_wins(0), shared_visits(0), available_node_count(-1){}
+    node(std::vector<int> inp) : win_count(0), visit_count(0), shared_wins(0), shared_visits(0), available_node_count(-1), empty_vector(inp){}
+    node(const board& b) : win_count(0), visit_count(0), shared_wins(0), shared_visits(0), available_node_count(-1){
+        for(int i=0;i<board::size_x*board::size_y;i++){
+			if(b(i) == board::empty) empty_vector.push_back(i);
 		}
+        count_node_bytes(bytes());
+    }
+    ~node(){
+        release_scope scope;
+        release_scope::freed() += bytes();
+        for(auto n : level_vector) delete n;
+    }
+
+    /**
+     * sums the bytes of the nodes deleted on this thread, and counts them at once when the outermost deletion ends
+     */
+    struct release_scope{
+        release_scope(){ depth()++; }
+        ~release_scope(){
+            if(--depth()) return;
+            count_node_bytes(-freed());
+            freed() = 0;
+        }
+        static int& depth(){ static thread_local int d = 0; return d; }
+        static int64_t& freed(){ static thread_local int64_t bytes = 0; return bytes; }
+    };
+
+    /**
+     * delete the children and free their memory, the node keeps its statistics and can be expanded again
+     */
+    void collapse(){
+        release_scope scope;
+        release_scope::freed() += level_vector.capacity()*sizeof(node*) + child_stats.capacity()*sizeof(float);
+        for(auto n : level_vector) delete n;
+        std::vector<node*>().swap(level_vector);
+        std::vector<float>().swap(child_stats);
+        available_node_count = -1;
+    }
+
+    /**
+     * whether the move is the lowest point of its orbit under the given set of symmetries
+     */
+    static bool representative(const int& move, const unsigned& stable){
+        for(unsigned s=1;s<board::symmetries();s++){
+            if((stable >> s & 1) && board::transform(move, s) < move) return false;
+        }
+        return true;
+    }
+
+    /**
+     * apply the symmetry s to the moves of this subtree, for taking over a subtree of an equivalent move
+     */
+    void transform(const unsigned& s){
+        move_position = board::transform(move_position, s);
+        for(int& p : empty_vector) p = board::transform(p, s);
+        for(auto n : level_vector) n->transform(s);
+    }
+
+    /**
+     * map every child to the lowest point of its orbit under the symmetries of the state, as level_vec_init
+     * expands it, together with its subtree, so that a transformed subtree has the moves of a fresh tree
+     */
+    void canonicalize(const board& state){
+        if(level_vector.empty()) return;
+        unsigned stable = state.stabilizer();
+        board after;
+        for(auto n : level_vector){
+            unsigned t = 0;
+            for(unsigned s=1;s<board::symmetries();s++){
+                if((stable >> s & 1) && board::transform(n->move_position, s) < board::transform(n->move_position, t)) t = s;
+            }
+            if(t) n->transform(t); // t leaves the state unchanged, so the child is still a move of it
+            after = state;
+            after.place_at(n->move_position);
+            n->canonicalize(after);
+        }
     }
-    ~node(){for(auto n : level_vector) delete n;}
 
-    void level_vec_init(const board& state){
+    size_t bytes() const{
+        return sizeof(node) + level_vector.capacity()*sizeof(node*) + empty_vector.capacity()*sizeof(int) + child_stats.capacity()*sizeof(float);
+    }
+
+    /**
+     * the bytes added by the expansion of this node, its children and the vectors which refer to them
+     */
+    size_t level_bytes() const{
+        size_t total = level_vector.capacity()*sizeof(node*) + child_stats.capacity()*sizeof(float);
+        for(auto n : level_vector) total += n->bytes();
+        return total;
+    }
+
+    double own_visits() const{ return visit_count - shared_visits; }
+    double own_wins() const{ return win_count - shared_wins; }
+
+    size_t stride() const{ return (level_vector.size() + 3) & ~size_t(3); }
+    float* child_wins(){ return child_stats.data(); }
+    float* child_visits(){ return child_stats.data() + stride(); }
+    const float* child_wins() const{ return child_stats.data(); }
+    const float* child_visits() const{ return child_stats.data() + stride(); }
+
+    /**
+     * expand the legal moves of the state, or only the first move of every orbit under the symmetries
+     * of the state if symmetric, since the other moves of an orbit lead to equivalent positions
+     */
+    void level_vec_init(const board& state, const bool& symmetric = false){
         board after;
+        unsigned stable = symmetric ? state.stabilizer() : 1;
         for(int i=0;i<empty_vector.size();i++){
+            if(stable != 1 && !representative(empty_vector[i], stable)) continue;
             after = state;
-            if(after.place(empty_vector[i]) == board::legal){
+            if(after.place_at(empty_vector[i]) == board::legal){
                 node* tmp = new node(empty_vector);
                 tmp->empty_vector.erase(tmp->empty_vector.begin()+i);
                 tmp->move_position = empty_vector[i];
                 level_vector.push_back(tmp);
             }
         }
+        child_stats.assign(stride()*2, 0);
+        for(size_t i=level_vector.size();i<stride();i++){
+            child_wins()[i] = -1e30f;
+            child_visits()[i] = 1;
+        }
+        if(node_bytes_counted().load(std::memory_order_relaxed)) count_node_bytes(level_bytes());
         available_node_count = level_vector.size();
     }
 };
+
+
+/**
+ * what a search thread did for one move, collected only when the telemetry is on
+ */
+struct search_stats{
+    int simulations;
+    int64_t selection_ns;
+    int64_t expansion_ns;
+    int64_t rollout_ns;
+    int64_t backprop_ns;
+    int max_depth;
+    int64_t depth_sum;
+    int64_t nodes;
+    int64_t bytes;
+    std::string stop;
+    search_stats() : simulations(0), selection_ns(0), expansion_ns(0), rollout_ns(0), backprop_ns(0),
+        max_depth(0), depth_sum(0), nodes(0), bytes(0), stop("none"){}
+};
+
+/**
+ * the statistics of a root child with its principal variation, published for the analysis
+ */
+struct root_summary{
+    int move;
+    double visits;
+    double wins;
+    std::vector<int> pv;
+};
+
+/**
+ * where the search threads publish their latest root summaries, one slot per thread
+ */
+struct analysis_board{
+    std::mutex lock;
+    std::vector<std::vector<root_summary>> slots;
+};
+
+/**
+ * where the search threads exchange the statistics of their roots and shallow nodes, one slot per thread
+ * a slot is written only by its own thread and read by the others without any lock, see mcts_management::Synchronize
+ * an entry holds the own visits and wins of a root child, or of a child of a root child
+ */
+struct sync_board{
+    enum { cells = board::size_x*board::size_y, entries = cells*(cells+1) };
+    struct entry{
+        std::atomic<int32_t> visits;
+        std::atomic<int32_t> wins;
+    };
+    int interval;
+    std::vector<std::unique_ptr<entry[]>> slots;
+
+    sync_board(const int& threads, const int& interval) : interval(std::max(interval, 1)){
+        for(int i=0;i<threads;i++) slots.emplace_back(new entry[entries]);
+        reset();
+    }
+
+    /**
+     * forget the entries of the last search, since the keys are relative to the root
+     */
+    void reset(){
+        for(auto& slot : slots){
+            for(int k=0;k<entries;k++){
+                slot[k].visits.store(0, std::memory_order_relaxed);
+                slot[k].wins.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static int key(const int& first, const int& second = -1){ return first*(cells+1) + second+1; }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "struct.h"
+
+/**
+ * per-move search telemetry written as JSON lines to stderr or appended to a file
+ * the lines of all the players in the process are serialized, so they may share one file
+ */
+class telemetry{
+public:
+	telemetry(const std::string& path = "") : out_(nullptr){
+		if(path.empty()) return;
+		if(path == "stderr"){
+			out_ = &std::cerr;
+		}else{
+			file_ = std::make_shared<std::ofstream>(path, std::ios::out | std::ios::app);
+			out_ = file_.get();
+		}
+	}
+
+	bool enabled() const { return out_ != nullptr; }
+
+	/**
+	 * one line for one move: the wall time, the best move, the merged root visits and what every thread did
+	 */
+	void write(const int& step, const std::string& who, const int64_t& wall_ms, const int& best,
+		const std::unordered_map<int, int>& visits, const std::vector<search_stats>& threads){
+		if(!enabled()) return;
+		std::stringstream line;
+		line << "{\"step\":" << step << ",\"who\":\"" << who << "\",\"wall_ms\":" << wall_ms;
+		line << ",\"best\":\"" << std::string(board::point(best)) << "\"";
+		line << ",\"threads\":[";
+		for(size_t i=0;i<threads.size();i++){
+			const search_stats& t = threads[i];
+			line << (i ? "," : "") << "{\"sims\":" << t.simulations
+				<< ",\"selection_ms\":" << t.selection_ns / 1e6
+				<< ",\"expansion_ms\":" << t.expansion_ns / 1e6
+				<< ",\"rollout_ms\":" << t.rollout_ns / 1e6
+				<< ",\"backprop_ms\":" << t.backprop_ns / 1e6
+				<< ",\"max_depth\":" << t.max_depth
+				<< ",\"avg_depth\":" << (t.simulations ? t.depth_sum * 1.0 / t.simulations : 0)
+				<< ",\"nodes\":" << t.nodes
+				<< ",\"bytes\":" << t.bytes
+				<< ",\"stop\":\"" << t.stop << "\"}";
+		}
+		line << "],\"visits\":{";
+		bool first = true;
+		for(int i=0;i<board::size_x*board::size_y;i++){
+			auto it = visits.find(i);
+			if(it == visits.end()) continue;
+			line << (first ? "" : ",") << "\"" << std::string(board::point(i)) << "\":" << it->second;
+			first = false;
+		}
+		line << "}}";
+
+		std::lock_guard<std::mutex> guard(lock());
+		*out_ << line.str() << std::endl;
+	}
+
+protected:
+	static std::mutex& lock(){ static std::mutex m; return m; }
+
+private:
+	std::ostream* out_;
+	std::shared_ptr<std::ofstream> file_;
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include "../board.h"
+
+/**
+ * game clock driven by the GTP commands time_settings and time_left
+ * all the times are kept in milliseconds, GTP sends them in seconds
+ */
+class time_control{
+public:
+	time_control() : main_time_(0), byo_yomi_time_(0), byo_yomi_stones_(0), time_left_(0), stones_left_(0), enabled_(false){}
+
+	/**
+	 * time_settings main_time byo_yomi_time byo_yomi_stones
+	 * byo_yomi_time > 0 with byo_yomi_stones == 0 means no time limit
+	 */
+	void settings(const std::string& args){
+		std::stringstream ss(args);
+		double main_time = 0, byo_yomi_time = 0;
+		int byo_yomi_stones = 0;
+		ss >> main_time >> byo_yomi_time >> byo_yomi_stones;
+		main_time_ = main_time * 1000;
+		byo_yomi_time_ = byo_yomi_time * 1000;
+		byo_yomi_stones_ = byo_yomi_stones;
+		time_left_ = main_time_;
+		stones_left_ = 0;
+		enabled_ = (main_time_ > 0 || byo_yomi_time_ > 0) && !(byo_yomi_time_ > 0 && byo_yomi_stones_ == 0);
+		if(main_time_ == 0 && enabled_){ // start directly in byo-yomi
+			time_left_ = byo_yomi_time_;
+			stones_left_ = byo_yomi_stones_;
+		}
+	}
+
+	/**
+	 * time_left color time stones
+	 * stones > 0 indicates the clock is in byo-yomi with that many stones to play
+	 */
+	void left(const std::string& args){
+		std::stringstream ss(args);
+		std::string color;
+		double time = 0;
+		int stones = 0;
+		ss >> color >> time >> stones;
+		time_left_ = time * 1000;
+		stones_left_ = stones;
+	}
+
+	bool enabled() const { return enabled_; }
+
+	/**
+	 * estimate how many moves we still have to play from the empty points,
+	 * about 4/5 of them are filled before someone runs out of legal moves
+	 */
+	static int moves_left(const board& state){
+		int empty = 0;
+		for(int i=0;i<board::size_x*board::size_y;i++){
+			if(state(i) == board::empty) empty++;
+		}
+		int moves = empty * 2 / 5;
+		return moves > min_moves_left ? moves : min_moves_left;
+	}
+
+	/**
+	 * the time budget for the next move, the margin is kept for joining the search threads
+	 * and tearing down the trees so the reply is sent before the clock runs out
+	 */
+	int64_t allocate(const board& state, const int64_t& margin) const{
+		int64_t budget, cap;
+		if(stones_left_ > 0){ // in byo-yomi, share the period between the remaining stones
+			budget = time_left_ / stones_left_;
+			cap = time_left_;
+		}else{
+			int64_t byo_yomi = byo_yomi_stones_ > 0 ? byo_yomi_time_ / byo_yomi_stones_ : 0;
+			budget = time_left_ / moves_left(state) + byo_yomi;
+			cap = time_left_ + byo_yomi;
+		}
+		budget = std::min(budget, cap) - margin;
+		return budget > min_budget ? budget : min_budget;
+	}
+
+	/**
+	 * the most a single move may take, used when the search decides to extend its budget
+	 */
+	int64_t reserve(const board& state, const int64_t& margin) const{
+		int64_t cap = time_left_;
+		if(stones_left_ == 0 && byo_yomi_stones_ > 0) cap += byo_yomi_time_ / byo_yomi_stones_;
+		int64_t limit = std::min(allocate(state, margin) * 2, cap - margin);
+		return limit > min_budget ? limit : min_budget;
+	}
+
+	/**
+	 * charge the time used by a move, until the next time_left corrects the clock
+	 */
+	void spend(const int64_t& used){
+		if(!enabled_) return;
+		time_left_ -= used;
+		if(stones_left_ > 0){
+			if(--stones_left_ == 0){ // a new byo-yomi period begins
+				time_left_ = byo_yomi_time_;
+				stones_left_ = byo_yomi_stones_;
+			}
+		}else if(time_left_ <= 0 && byo_yomi_stones_ > 0){
+			time_left_ = byo_yomi_time_;
+			stones_left_ = byo_yomi_stones_;
+		}
+		time_left_ = std::max<int64_t>(time_left_, 0);
+	}
+
+private:
+	static constexpr int min_moves_left = 4;
+	static constexpr int64_t min_budget = 10;
+
+	int64_t main_time_;
+	int64_t byo_yomi_time_;
+	int byo_yomi_stones_;
+	int64_t time_left_;
+	int stones_left_;
+	bool enabled_;
+};
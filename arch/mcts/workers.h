@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../board.h"
+#include "mcts_compare.h"
+#include "../scheduler.h"
+
+/**
+ * the search to run in every worker process, written by the coordinator
+ */
+struct worker_job{
+	board state;
+	int game_step;
+	int timed;
+	uint64_t time_limit;
+	uint64_t hard_limit;
+};
+
+/**
+ * a pool of forked search processes cooperating on the searches of the coordinator
+ * the job and the root visits of every worker live in one POSIX shared memory area,
+ * the coordinator bumps the generation to start a search and merges the visits of
+ * every worker which reported the same generation; a crashed worker is simply left out
+ */
+class worker_pool{
+public:
+	enum { max_workers = 64, cells = board::size_x * board::size_y };
+	typedef std::function<std::unordered_map<int, int>(const worker_job&, const int&, const std::atomic<bool>*)> search_func;
+
+	/**
+	 * fork count worker processes right away, every worker runs search (with its index) for each job until the pool is destroyed
+	 * the pool must be created before the process starts any thread, so it stays empty once the scheduler has started
+	 */
+	worker_pool(const int& count, const search_func& search) : area_(nullptr){
+		if(scheduler::instance().enabled()){
+			std::cerr << "workers= ignored, the process cannot fork after the scheduler started" << std::endl;
+			return;
+		}
+		std::string name = "/nogo-" + std::to_string(::getpid()) + "-" + std::to_string(serial()++);
+		int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if(fd < 0) return;
+		if(::ftruncate(fd, sizeof(shared_area)) == 0){
+			void* map = ::mmap(nullptr, sizeof(shared_area), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if(map != MAP_FAILED) area_ = new (map) shared_area();
+		}
+		::close(fd);
+		::shm_unlink(name.c_str()); // the mappings keep the area alive, nothing is left behind
+		if(!area_) return;
+
+		pid_t parent = ::getpid();
+		for(int i=0;i<std::min<int>(count, max_workers);i++){
+			pid_t pid = ::fork();
+			if(pid == 0){
+				::prctl(PR_SET_PDEATHSIG, SIGKILL);
+				if(::getppid() != parent) ::_exit(0);
+				serve(i, search);
+				::_exit(0);
+			}
+			pids_.push_back(pid); // -1 keeps the slots aligned when the fork fails
+		}
+	}
+	~worker_pool(){
+		if(!area_) return;
+		area_->stop = true; // a worker still searching would not see quit until its search ends
+		area_->quit = true;
+		for(pid_t pid : pids_) if(pid > 0) ::waitpid(pid, nullptr, 0);
+		area_->~shared_area();
+		::munmap(area_, sizeof(shared_area));
+	}
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator =(const worker_pool&) = delete;
+
+	size_t size() const { return pids_.size(); }
+
+	/**
+	 * hand the job to every worker
+	 */
+	void start(const worker_job& job){
+		if(!area_) return;
+		area_->stop = false;
+		area_->job = job;
+		area_->generation.fetch_add(1, std::memory_order_release);
+	}
+
+	/**
+	 * stop the workers, wait until every live worker has reported or the deadline passes,
+	 * and add their root visits into the table
+	 * a deadline of 0 lets every live worker finish its search instead, as the reproducible searches need
+	 */
+	void merge(std::unordered_map<int, int>& table, const uint64_t& deadline){
+		if(!area_) return;
+		if(deadline) area_->stop = true;
+		uint32_t generation = area_->generation.load();
+		for(size_t i=0;i<pids_.size();i++){
+			worker_slot& slot = area_->slots[i];
+			while(slot.done.load(std::memory_order_acquire) != generation && alive(i) && (!deadline || time_compare::millisec() < deadline)){
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+			if(slot.done.load(std::memory_order_acquire) != generation) continue;
+			for(int p=0;p<cells;p++){
+				if(slot.visits[p]) table[p] += slot.visits[p];
+			}
+		}
+	}
+
+protected:
+	struct worker_slot{
+		std::atomic<uint32_t> done;
+		int visits[cells];
+	};
+	struct shared_area{
+		std::atomic<uint32_t> generation;
+		std::atomic<bool> stop;
+		std::atomic<bool> quit;
+		worker_job job;
+		worker_slot slots[max_workers];
+		shared_area() : generation(0), stop(false), quit(false){
+			for(worker_slot& s : slots) s.done = 0;
+		}
+	};
+
+	/**
+	 * the loop of a worker process: wait for a new generation, search, and report
+	 */
+	void serve(const int& i, const search_func& search){
+		worker_slot& slot = area_->slots[i];
+		for(uint32_t seen = 0; !area_->quit; ){
+			uint32_t generation = area_->generation.load(std::memory_order_acquire);
+			if(generation == seen){
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				continue;
+			}
+			seen = generation;
+			worker_job job = area_->job; // the search keeps referring to the board, which the next start() overwrites
+			std::unordered_map<int, int> table = search(job, i, &area_->stop);
+			std::fill(slot.visits, slot.visits + cells, 0);
+			for(auto subn : table) if(subn.first >= 0 && subn.first < cells) slot.visits[subn.first] = subn.second;
+			slot.done.store(generation, std::memory_order_release);
+		}
+	}
+
+	bool alive(const size_t& i){
+		if(pids_[i] <= 0) return false;
+		if(::waitpid(pids_[i], nullptr, WNOHANG) == 0) return true;
+		pids_[i] = -1; // reaped, never waited again
+		return false;
+	}
+
+	static int& serial(){ static int n = 0; return n; }
+
+private:
+	shared_area* area_;
+	std::vector<pid_t> pids_;
+};
@@ -10,23 +10,26 @@
 #include <iostream>
 #include <fstream>
 #include <iterator>
+#include <sstream>
 #include <string>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistics.h"
+#include "arena.h"
+#include "selfplay.h"
+#include "perft.h"
+#include "server.h"
+#include "tuning.h"
+#include "scheduler.h"
 
 int main(int argc, const char* argv[]) {
-	std::cout << "HollowNoGo-Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
-
-	size_t total = 1000, block = 0, limit = 0;
+	size_t total = 1000, block = 0, limit = 0, parallel = 1, cores = 0;
 	std::string black_args, white_args;
-	std::string load_path, save_path;
+	std::string load_path, save_path, record_path, sprt_args, selfplay_args, tune_args, serve_args, perft_args;
 	std::string name = "TCG-HollowNoGo-Demo", version = "2022"; // for GTP shell
-	bool shell = false;
+	bool shell = false, sprt = false, serve = false, perft = false;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		auto match_arg = [&](std::string flag) -> bool {
@@ -43,6 +46,23 @@ int main(int argc, const char* argv[]) {
 			block = std::stoull(next_opt());
 		} else if (match_arg("limit")) {
 			limit = std::stoull(next_opt());
+		} else if (match_arg("parallel")) {
+			parallel = std::stoull(next_opt());
+		} else if (match_arg("cores")) {
+			cores = std::stoull(next_opt());
+		} else if (match_arg("sprt")) {
+			sprt_args = next_opt();
+			sprt = true;
+		} else if (match_arg("tune")) {
+			tune_args = next_opt();
+		} else if (match_arg("selfplay")) {
+			selfplay_args = next_opt();
+		} else if (match_arg("serve")) {
+			serve_args = arg.find('=') != std::string::npos ? next_opt() : "";
+			serve = true;
+		} else if (match_arg("perft")) {
+			perft_args = next_opt();
+			perft = true;
 		} else if (match_arg("black")) {
 			black_args = next_opt();
 		} else if (match_arg("white")) {
@@ -51,6 +71,8 @@ int main(int argc, const char* argv[]) {
 			load_path = next_opt();
 		} else if (match_arg("save")) {
 			save_path = next_opt();
+		} else if (match_arg("record")) {
+			record_path = next_opt();
 		} else if (match_arg("name")) {
 			name = next_opt();
 		} else if (match_arg("version")) {
@@ -60,19 +82,58 @@ int main(int argc, const char* argv[]) {
 		}
 	}
 
+	std::ostream& banner = serve ? std::cerr : std::cout; // the stdout of --serve carries only the results
+	banner << "HollowNoGo-Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(banner, " "));
+	banner << std::endl << std::endl;
+
+	if (perft) return run_perft(perft_args) ? 0 : 1;
+	if (serve) { // the server searches on its own trees, so no player (nor its worker processes) is created
+		scheduler::instance().start(cores);
+		return server(serve_args).run();
+	}
+
 	statistics stats(total, block, limit);
 
 	if (load_path.size()) {
-		std::ifstream in(load_path, std::ios::in);
-		in >> stats;
-		in.close();
+		if (game_record::is_binary(load_path)) {
+			stats.load_record(load_path);
+		} else {
+			std::ifstream in(load_path, std::ios::in);
+			in >> stats;
+			in.close();
+		}
 		if (stats.is_finished()) stats.summary();
 	}
+	if (record_path.size()) stats.record(record_path);
 
-	player black("c=0.3 N=100 T=10005 thread=1 tm=0 search=" + black_args + " role=black name=tcg_judge");
-	player white("c=0.3 N=100 T=10005 thread=1 tm=0 search=" + white_args + " role=white name=tcg_judge");
+	black_args = "c=0.3 N=100 T=10005 thread=1 tm=0 ponder=0 margin=50 adaptive=1 search=" + black_args + " role=black name=tcg_judge";
+	white_args = "c=0.3 N=100 T=10005 thread=1 tm=0 ponder=0 margin=50 adaptive=1 search=" + white_args + " role=white name=tcg_judge";
+	bool threaded = !shell && (sprt || tune_args.size() || selfplay_args.size() || parallel > 1);
+	if (threaded && (arena::forks(black_args) || arena::forks(white_args))) {
+		std::cerr << "workers= cannot be used with --parallel, --sprt, --selfplay, or --tune" << std::endl;
+		return 1;
+	}
+	player black(black_args);
+	player white(white_args);
+	scheduler::instance().start(cores); // after the players, which may fork their worker processes
 
-	if (!shell) { // launch standard local games
+	if (!shell && sprt) { // match black against white with alternating colors until decided
+		match test(black_args, white_args, parallel, sprt_args, block);
+		test.run(stats);
+		std::stringstream h0, h1;
+		h0 << "H0 accepted (A - B <= " << test.status().elo0 << " elo)";
+		h1 << "H1 accepted (A - B >= " << test.status().elo1 << " elo)";
+		std::string verdict[] = { h0.str(), "undecided", h1.str() };
+		std::cout << test.status() << std::endl;
+		std::cout << "match = " << verdict[test.decision() + 1] << std::endl;
+	} else if (!shell && tune_args.size()) { // tune the options of black by games against itself
+		spsa(black_args, parallel, tune_args).run();
+	} else if (!shell && selfplay_args.size()) { // launch local games and write the searched positions
+		selfplay(black_args, white_args, parallel, selfplay_args).run(stats);
+	} else if (!shell && parallel > 1) { // launch local games concurrently
+		arena(black_args, white_args, parallel).run(stats);
+	} else if (!shell) { // launch standard local games
 		while (!stats.is_finished()) {
 //			std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
 			black.open_episode("~:" + white.name());
@@ -94,9 +155,15 @@ int main(int argc, const char* argv[]) {
 			white.close_episode(win.name());
 		}
 	} else { // launch GTP shell
+		agent* analyzing = nullptr; // the player running the analysis started by the last command
 		for (std::string command; std::getline(std::cin, command); ) {
 			if (command.back() == '\r') command.pop_back();
 			if (command.empty()) continue;
+			if (analyzing) { // any command stops the analysis and ends its response
+				analyzing->stop_analyze();
+				analyzing = nullptr;
+				std::cout << std::endl;
+			}
 
 			std::vector<std::string> args;
 			std::istringstream iss(command);
@@ -143,10 +210,12 @@ int main(int argc, const char* argv[]) {
 						std::cerr << "reason: " << reason[std::min(-code, 7)] << std::endl;
 						break;
 					}
+					game.take_turns(black, white).ponder(game.state()); // keep the subtree of this move
 				} else if (args[0] == "genmove") { // generate a move and play
 					action::place move = who.take_action(game.state());
 					if (game.apply_action(move) == true) {
 						reply = move.position();
+						who.ponder(game.state()); // think on the opponent's time
 					} else { // I have no legal move to play
 						reply = "resign";
 					}
@@ -174,6 +243,38 @@ int main(int argc, const char* argv[]) {
 				}
 				if (size > board::size_x || size > board::size_y) break;
 
+			} else if (args[0] == "time_settings") { // set the time control of the game
+				std::string settings = command.substr(command.find(' ') + 1);
+				black.notify("time_settings=" + settings);
+				white.notify("time_settings=" + settings);
+
+			} else if (args[0] == "time_left") { // update the clock of a player
+				std::string left = command.substr(command.find(' ') + 1);
+				(std::tolower(args[1][0]) == 'b' ? black : white).notify("time_left=" + left);
+
+			} else if (args[0] == "analyze" || args[0] == "lz-analyze") { // analyze [color] [interval in centiseconds]
+				board state = stats.is_episode_ongoing() ? stats.back().state() : board();
+				size_t arg = 1;
+				if (args.size() > arg && std::string("bBwW").find(args[arg][0]) != std::string::npos) {
+					state.info({ std::tolower(args[arg++][0]) == 'b' ? board::black : board::white });
+				}
+				int interval = args.size() > arg ? std::stoi(args[arg]) * 10 : 1000;
+				agent& who = state.info().who_take_turns == board::black ? static_cast<agent&>(black) : white;
+				std::cout << "= " << std::endl;
+				if (who.analyze(state, std::max(interval, 10), std::cout)) {
+					analyzing = &who;
+				} else {
+					std::cout << std::endl;
+				}
+				continue;
+
+			} else if (args[0] == "profile") { // report the hot-path timing counters
+#ifdef NOGO_PROFILE
+				reply = "\n" + profile::dump();
+#else
+				reply = "profiling is disabled, build with make profile";
+#endif
+
 			} else if (args[0] == "name") { // report the name of the program
 				reply = name;
 			} else if (args[0] == "version") { // report the version number of the program
@@ -182,7 +283,7 @@ int main(int argc, const char* argv[]) {
 				reply = "2";
 			} else if (args[0] == "list_commands") { // print supported commands
 				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
-				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
+				        "time_settings\n" "time_left\n" "analyze\n" "lz-analyze\n" "profile\n" "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
 			} else {
 				reply = "unknown command";
 			}
@@ -191,11 +292,18 @@ int main(int argc, const char* argv[]) {
 		}
 	}
 
-	if (save_path.size()) {
+	if (save_path.size() > 4 && save_path.substr(save_path.size() - 4) == ".ngr") {
+		stats.save_record(save_path);
+	} else if (save_path.size()) {
 		std::ofstream out(save_path, std::ios::out | std::ios::trunc);
 		out << stats;
 		out.close();
 	}
+	if (save_path.size()) {
+		std::ofstream out(save_path + ".latency", std::ios::out | std::ios::trunc);
+		out << stats.latencies();
+		out.close();
+	}
 
 	return 0;
 }
@@ -0,0 +1,229 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * perft.h: Count the legal move tree and validate board implementations against a reference
+ */
+
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "board.h"
+
+/**
+ * the hollow points of the reference, written out again rather than taken from the board or the geometry
+ * tables, so that a wrong layout table shows up as a mismatch; the plain geometries have none
+ */
+template<class geometry>
+struct reference_layout {
+	static std::vector<std::pair<int, int>> hollow() { return {}; }
+};
+template<>
+struct reference_layout<hollow9> {
+	static std::vector<std::pair<int, int>> hollow() { // [x][y] as set by the original init_initial_scheme
+		return { { 4, 1 }, { 4, 2 }, { 4, 6 }, { 4, 7 }, { 1, 4 }, { 2, 4 }, { 6, 4 }, { 7, 4 } };
+	}
+};
+
+/**
+ * the plain rules of Hollow NoGo, written for clarity rather than speed
+ * this is the reference every optimized board must agree with, do not optimize it
+ */
+class reference_board {
+public:
+	reference_board() : turn(board::black) {
+		for (auto& column : stone) column.fill(board::empty);
+		for (auto p : reference_layout<NOGO_GEOMETRY>::hollow()) stone[p.first][p.second] = board::hollow;
+	}
+
+	board::reward place(int x, int y) {
+		if (x < 0 || x >= board::size_x || y < 0 || y >= board::size_y) return board::illegal_out_of_range;
+		if (stone[x][y] == board::hollow) return board::illegal_out_of_range;
+		if (stone[x][y] != board::empty) return board::illegal_not_empty;
+		stone[x][y] = turn;
+		if (!liberty(x, y)) { stone[x][y] = board::empty; return board::illegal_suicide; }
+		const int dx[] = { -1, 1, 0, 0 }, dy[] = { 0, 0, -1, 1 };
+		for (int d = 0; d < 4; d++) {
+			int nx = x + dx[d], ny = y + dy[d];
+			if (inside(nx, ny) && stone[nx][ny] == 3u - turn && !liberty(nx, ny)) {
+				stone[x][y] = board::empty;
+				return board::illegal_take;
+			}
+		}
+		turn = 3u - turn;
+		return board::legal;
+	}
+
+	unsigned operator ()(int i) const { return stone[i / board::size_y][i % board::size_y]; }
+	unsigned who_take_turns() const { return turn; }
+
+protected:
+	static bool inside(int x, int y) { return x >= 0 && x < board::size_x && y >= 0 && y < board::size_y; }
+
+	/**
+	 * whether the block containing [x][y] touches an empty point
+	 */
+	bool liberty(int x, int y) const {
+		std::vector<bool> seen(board::size_x * board::size_y, false);
+		std::vector<std::pair<int, int>> open = { { x, y } };
+		unsigned who = stone[x][y];
+		seen[x * board::size_y + y] = true;
+		const int dx[] = { -1, 1, 0, 0 }, dy[] = { 0, 0, -1, 1 };
+		while (open.size()) {
+			auto p = open.back();
+			open.pop_back();
+			for (int d = 0; d < 4; d++) {
+				int nx = p.first + dx[d], ny = p.second + dy[d];
+				if (!inside(nx, ny)) continue;
+				if (stone[nx][ny] == board::empty) return true;
+				if (stone[nx][ny] != who || seen[nx * board::size_y + ny]) continue;
+				seen[nx * board::size_y + ny] = true;
+				open.emplace_back(nx, ny);
+			}
+		}
+		return false;
+	}
+
+private:
+	board::grid stone;
+	unsigned turn;
+};
+
+/**
+ * perft and differential testing of a board type against the reference rules
+ */
+template<class board_type = board>
+class perft {
+public:
+	/**
+	 * count the leaves of the legal move tree of the given depth
+	 */
+	static uint64_t count(const board_type& state, int depth) {
+		if (depth == 0) return 1;
+		uint64_t leaves = 0;
+		for (int i = 0; i < board::size_x * board::size_y; i++) {
+			board_type after = state;
+			if (after.place(i) != board::legal) continue;
+			leaves += depth == 1 ? 1 : count(after, depth - 1);
+		}
+		return leaves;
+	}
+
+	/**
+	 * play random games on both implementations side by side and compare every move result,
+	 * every resulting position and the side to move; return the number of mismatches
+	 */
+	static size_t differential(size_t games, unsigned seed, std::ostream& log, uint64_t& positions) {
+		std::default_random_engine engine(seed);
+		size_t mismatch = 0;
+		positions = 0;
+		std::vector<int> space(board::size_x * board::size_y);
+		for (size_t i = 0; i < space.size(); i++) space[i] = i;
+		for (size_t g = 0; g < games; g++) {
+			board_type fast;
+			reference_board slow;
+			for (int j = 0; j < board::size_x * board::size_y; j++) {
+				if (unsigned(fast(j)) == slow(j)) continue;
+				log << "game " << g << ": " << std::string(board::point(j)) << " differs in the initial position" << std::endl << fast;
+				mismatch++;
+				break;
+			}
+			for (bool moved = true; moved; ) {
+				moved = false;
+				std::shuffle(space.begin(), space.end(), engine);
+				for (int i : space) { // probe every point in random order, the first legal one is played
+					board_type after = fast;
+					reference_board check = slow;
+					board::reward a = after.place(board::point(i)), b = check.place(i / board::size_y, i % board::size_y);
+					positions++;
+					if (a != b) {
+						log << "game " << g << ": " << std::string(board::point(i)) << " is " << a << " but " << b << " expected" << std::endl << fast;
+						mismatch++;
+						break;
+					}
+					if (a != board::legal) continue;
+					fast = after;
+					slow = check;
+					for (int j = 0; j < board::size_x * board::size_y; j++) {
+						if (unsigned(fast(j)) != slow(j)) {
+							log << "game " << g << ": " << std::string(board::point(j)) << " differs after " << std::string(board::point(i)) << std::endl << fast;
+							mismatch++;
+							break;
+						}
+					}
+					if (unsigned(fast.info().who_take_turns) != slow.who_take_turns()) mismatch++;
+					moved = true;
+					break;
+				}
+			}
+		}
+		return mismatch;
+	}
+};
+
+/**
+ * run perft to the given depth from the initial position and from seeded random positions,
+ * then run the differential games, printing one line per result
+ * the args are in the form of "depth=3 positions=4 games=1000 seed=2022 moves=E5,C3"
+ * return whether the differential games found no mismatch
+ */
+inline bool run_perft(const std::string& args, std::ostream& out = std::cout) {
+	int depth = 2;
+	size_t positions = 4, games = 1000;
+	unsigned seed = 2022;
+	std::string moves;
+	std::stringstream ss(args);
+	for (std::string pair; ss >> pair; ) {
+		std::string key = pair.substr(0, pair.find('='));
+		std::string value = pair.substr(pair.find('=') + 1);
+		if (key == "depth") depth = std::stoi(value);
+		if (key == "positions") positions = std::stoull(value);
+		if (key == "games") games = std::stoull(value);
+		if (key == "seed") seed = std::stoul(value);
+		if (key == "moves") moves = value;
+	}
+	auto now = []() { return std::chrono::steady_clock::now(); };
+	auto seconds = [](std::chrono::steady_clock::duration d) { return std::chrono::duration<double>(d).count(); };
+
+	std::vector<board> start(1);
+	for (size_t p = 0; p < moves.size(); ) { // moves=E5,C3,... from the initial position
+		size_t q = moves.find(',', p);
+		std::string mv = moves.substr(p, q == std::string::npos ? std::string::npos : q - p);
+		if (start[0].place(board::point(mv)) != board::legal) out << "perft: illegal move " << mv << std::endl;
+		p = q == std::string::npos ? moves.size() : q + 1;
+	}
+	std::default_random_engine engine(seed);
+	while (start.size() < positions + 1) {
+		board state = start[0];
+		for (int d = std::uniform_int_distribution<int>(5, 40)(engine); d > 0; d--) {
+			std::vector<int> legal;
+			for (int i = 0; i < board::size_x * board::size_y; i++) {
+				board after = state;
+				if (after.place(i) == board::legal) legal.push_back(i);
+			}
+			if (legal.empty()) break;
+			state.place(legal[std::uniform_int_distribution<size_t>(0, legal.size() - 1)(engine)]);
+		}
+		start.push_back(state);
+	}
+
+	for (size_t p = 0; p < start.size(); p++) {
+		for (int d = 1; d <= depth; d++) {
+			auto t = now();
+			uint64_t leaves = perft<board>::count(start[p], d);
+			double elapsed = seconds(now() - t);
+			out << "perft position=" << p << " depth=" << d << " leaves=" << leaves
+			    << " nps=" << uint64_t(leaves / std::max(elapsed, 1e-9)) << std::endl;
+		}
+	}
+
+	uint64_t probes = 0;
+	auto t = now();
+	size_t mismatch = perft<board>::differential(games, seed, out, probes);
+	double elapsed = seconds(now() - t);
+	out << "differential games=" << games << " positions=" << probes << " mismatch=" << mismatch
+	    << " pps=" << uint64_t(probes / std::max(elapsed, 1e-9)) << std::endl;
+	return mismatch == 0;
+}
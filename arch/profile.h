@@ -0,0 +1,124 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * profile.h: Low-overhead timing counters of the hot paths
+ *
+ * the counters are compiled only with -DNOGO_PROFILE (see "make profile"), otherwise
+ * PROFILE_SCOPE and PROFILE_FLUSH expand to nothing
+ *
+ * every thread counts the ticks and the calls of each scope in its own counters, which are
+ * merged into the process-wide totals at the end of each search and when the thread exits
+ */
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class profile {
+public:
+	enum scope_id { selection_expansion, rollout, backpropagation, board_place, check_liberty, scope_count };
+
+	/**
+	 * the time stamp counter on x86, or nanoseconds elsewhere
+	 */
+	static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	struct tally {
+		std::array<uint64_t, scope_count> ticks;
+		std::array<uint64_t, scope_count> calls;
+		tally() { ticks.fill(0); calls.fill(0); }
+	};
+	struct counters : tally {
+		~counters() { flush(*this); }
+	};
+
+	class scope {
+	public:
+		scope(scope_id id) : id(id), start(profile::ticks()) {}
+		~scope() {
+			counters& local = profile::local();
+			local.ticks[id] += profile::ticks() - start;
+			local.calls[id]++;
+		}
+	private:
+		scope_id id;
+		uint64_t start;
+	};
+
+	static counters& local() { static thread_local counters c; return c; }
+
+	/**
+	 * merge the counters of this thread into the totals
+	 */
+	static void flush(tally& c = local()) {
+		std::lock_guard<std::mutex> guard(total().lock);
+		for (size_t i = 0; i < scope_count; i++) {
+			total().sum.ticks[i] += c.ticks[i];
+			total().sum.calls[i] += c.calls[i];
+		}
+		c.ticks.fill(0);
+		c.calls.fill(0);
+	}
+
+	/**
+	 * the totals as a table of calls, ticks and ticks per call
+	 */
+	static std::string dump() {
+		flush();
+		const char** name = names();
+		std::stringstream out;
+		std::lock_guard<std::mutex> guard(total().lock);
+		out << std::left << std::setw(20) << "scope" << std::right << std::setw(14) << "calls"
+		    << std::setw(18) << "ticks" << std::setw(14) << "ticks/call";
+		for (size_t i = 0; i < scope_count; i++) {
+			uint64_t calls = total().sum.calls[i], ticks = total().sum.ticks[i];
+			out << std::endl << std::left << std::setw(20) << name[i] << std::right << std::setw(14) << calls
+			    << std::setw(18) << ticks << std::setw(14) << (calls ? ticks / calls : 0);
+		}
+		return out.str();
+	}
+
+protected:
+	static const char** names() {
+		static const char* name[] = { "selection_expansion", "rollout", "backpropagation", "board_place", "check_liberty" };
+		return name;
+	}
+
+	struct totals {
+		tally sum;
+		std::mutex lock;
+		~totals() { // report at process exit
+			bool used = false;
+			for (uint64_t calls : sum.calls) used = used || calls;
+			if (!used) return;
+			for (size_t i = 0; i < scope_count; i++) {
+				std::cerr << "profile " << names()[i] << " calls=" << sum.calls[i] << " ticks=" << sum.ticks[i] << std::endl;
+			}
+		}
+	};
+	static totals& total() { static totals t; return t; }
+};
+
+#ifdef NOGO_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(id) profile::scope PROFILE_CONCAT(profile_scope_, __LINE__)(profile::id)
+#define PROFILE_FLUSH() profile::flush()
+#else
+#define PROFILE_SCOPE(id)
+#define PROFILE_FLUSH()
+#endif
@@ -0,0 +1,200 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * record.h: Compact binary game records, appended as games finish and read through mmap
+ *
+ * the file starts with the header "NGR1" followed by size_x and size_y (1 byte each) and 2 reserved bytes,
+ * then the games follow one after another, each game is stored as
+ *   uint32 length of the rest of the game
+ *   int64  open time, int64 close time (milliseconds since epoch)
+ *   uint8  length + open tag (e.g., "black:white"), uint8 length + close tag (the winner)
+ *   uint16 number of moves
+ *   one byte per move: the position, with the highest bit set for white
+ *   one varint per move: the time taken in milliseconds
+ * all the integers are little-endian
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "board.h"
+#include "action.h"
+#include "episode.h"
+
+class game_record {
+public:
+	static_assert(board::size_x * board::size_y <= 128, "a move is stored as its position in 7 bits");
+	enum { header_size = 8 };
+	static const char* magic() { return "NGR1"; }
+
+	static std::string header() {
+		std::string buf(magic(), 4);
+		buf.push_back(char(board::size_x));
+		buf.push_back(char(board::size_y));
+		buf.append(2, '\0');
+		return buf;
+	}
+
+	/**
+	 * whether the file at path starts with the binary header
+	 */
+	static bool is_binary(const std::string& path) {
+		char buf[4] = {};
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		return in.read(buf, 4) && std::memcmp(buf, magic(), 4) == 0;
+	}
+
+	/**
+	 * append an episode to the buffer
+	 */
+	static void encode(const episode& ep, std::string& buf) {
+		std::string body;
+		put(body, uint64_t(ep.ep_open.when), 8);
+		put(body, uint64_t(ep.ep_close.when), 8);
+		for (const std::string& tag : { ep.ep_open.tag, ep.ep_close.tag }) {
+			size_t len = std::min<size_t>(tag.size(), 255);
+			body.push_back(char(len));
+			body.append(tag, 0, len);
+		}
+		put(body, ep.ep_moves.size(), 2);
+		for (const episode::move& mv : ep.ep_moves) {
+			body.push_back(char((mv.code.position & 0x7f) | (mv.code.who == board::white ? 0x80 : 0)));
+		}
+		for (const episode::move& mv : ep.ep_moves) {
+			for (uint64_t v = mv.time; ; v >>= 7) { // varint
+				body.push_back(char((v & 0x7f) | (v >= 0x80 ? 0x80 : 0)));
+				if (v < 0x80) break;
+			}
+		}
+		put(buf, body.size(), 4);
+		buf += body;
+	}
+
+	/**
+	 * read an episode from [p, end) and advance p, return false if the data is truncated
+	 */
+	static bool decode(const char*& p, const char* end, episode& ep) {
+		ep = {};
+		if (end - p < 4) return false;
+		size_t len = get(p, 4);
+		if (size_t(end - p) < len) return false;
+		const char* q = p, *stop = p + len;
+		p = stop;
+		if (stop - q < 17) return false;
+		ep.ep_open.when = get(q, 8);
+		ep.ep_close.when = get(q, 8);
+		for (std::string* tag : { &ep.ep_open.tag, &ep.ep_close.tag }) {
+			size_t n = uint8_t(*q++);
+			if (stop - q < ptrdiff_t(n) + 1) return false;
+			tag->assign(q, n);
+			q += n;
+		}
+		if (stop - q < 2) return false;
+		size_t moves = get(q, 2);
+		if (size_t(stop - q) < moves) return false;
+		const char* code = q;
+		q += moves;
+		for (size_t i = 0; i < moves; i++) {
+			uint8_t c = code[i];
+			uint64_t time = 0;
+			for (int shift = 0; q < stop; shift += 7) {
+				uint8_t b = *q++;
+				time |= uint64_t(b & 0x7f) << shift;
+				if (!(b & 0x80)) break;
+			}
+			ep.ep_moves.emplace_back(placement(c & 0x7f, c & 0x80 ? board::white : board::black), 0, time);
+		}
+		ep.recount();
+		return true;
+	}
+
+protected:
+	static void put(std::string& buf, uint64_t v, int bytes) {
+		for (int i = 0; i < bytes; i++, v >>= 8) buf.push_back(char(v & 0xff));
+	}
+	static uint64_t get(const char*& p, int bytes) {
+		uint64_t v = 0;
+		for (int i = 0; i < bytes; i++) v |= uint64_t(uint8_t(*p++)) << (8 * i);
+		return v;
+	}
+};
+
+/**
+ * append finished games to a binary record file, writing the header if the file is new
+ */
+class record_writer {
+public:
+	record_writer(const std::string& path) : out(path, std::ios::out | std::ios::binary | std::ios::app) {
+		if (out.tellp() == 0) out << game_record::header();
+	}
+
+	void append(const episode& ep) {
+		std::string buf;
+		game_record::encode(ep, buf);
+		out.write(buf.data(), buf.size());
+		out.flush();
+	}
+
+	/**
+	 * rewrite the whole file with the given episodes
+	 */
+	template<typename episodes>
+	static void save(const std::string& path, const episodes& data) {
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		std::string buf = game_record::header();
+		for (const episode& ep : data) game_record::encode(ep, buf);
+		out.write(buf.data(), buf.size());
+	}
+
+private:
+	std::ofstream out;
+};
+
+/**
+ * read the games of a binary record file through a read-only memory map
+ */
+class record_reader {
+public:
+	record_reader(const std::string& path) : base(nullptr), size(0), pos(nullptr) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && st.st_size >= off_t(game_record::header_size)) {
+			void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				base = static_cast<const char*>(map);
+				size = st.st_size;
+				::madvise(map, size, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+		if (base && std::memcmp(base, game_record::magic(), 4) == 0 &&
+			uint8_t(base[4]) == board::size_x && uint8_t(base[5]) == board::size_y) {
+			pos = base + game_record::header_size;
+		}
+	}
+	~record_reader() {
+		if (base) ::munmap(const_cast<char*>(base), size);
+	}
+	record_reader(const record_reader&) = delete;
+	record_reader& operator =(const record_reader&) = delete;
+
+	bool is_open() const { return pos != nullptr; }
+
+	/**
+	 * read the next game, return false at the end of the file
+	 */
+	bool next(episode& ep) {
+		return pos && game_record::decode(pos, base + size, ep);
+	}
+
+private:
+	const char* base;
+	size_t size;
+	const char* pos;
+};
@@ -0,0 +1,156 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * scheduler.h: One process-wide task scheduler for the games, the searches, and the evaluations
+ *
+ * with a core budget, e.g., --cores=8, the process runs cores - 1 worker threads, and the thread
+ * waiting for a task group is the remaining core; the arena submits its games, the MCTS player
+ * submits its search trees in chunks of simulations, and the server submits its positions, so
+ * the idle cores help the busy searches instead of every search spawning its own threads
+ * every task group keeps its own queue, a waiting thread only runs the tasks of its own group,
+ * e.g., the game waiting for its search never picks up another game, while the workers steal
+ * from any group in turn; without a budget, everything keeps running on its own threads
+ * no process may fork once the workers started, see worker_pool
+ */
+
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class task_group;
+
+class scheduler {
+public:
+	static scheduler& instance() {
+		static scheduler pool;
+		return pool;
+	}
+	~scheduler() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread& th : workers) th.join();
+	}
+
+	/**
+	 * set the core budget and start the workers, only the first call counts
+	 */
+	void start(size_t cores) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (budget || cores == 0) return;
+		budget = cores;
+		for (size_t i = 1; i < cores; i++) workers.emplace_back(&scheduler::work, this, i);
+	}
+
+	bool enabled() const { return budget > 0; }
+	size_t cores() const { return budget; }
+
+protected:
+	friend class task_group;
+	struct queue {
+		std::deque<std::function<void()>> tasks;
+		size_t pending;
+		std::condition_variable ready; // the thread waiting for the group, woken by its own tasks only
+		queue() : pending(0) {}
+	};
+
+	scheduler() : budget(0), quit(false) {}
+
+	void attach(queue* q) {
+		std::lock_guard<std::mutex> guard(lock);
+		groups.push_back(q);
+	}
+	void detach(queue* q) {
+		std::lock_guard<std::mutex> guard(lock);
+		groups.erase(std::find(groups.begin(), groups.end(), q));
+	}
+
+	void submit(queue* q, std::function<void()>&& task) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			q->tasks.push_back(std::move(task));
+			q->pending++;
+		}
+		wake.notify_one(); // one idle worker, or the waiter of the group below, is enough for one task
+		q->ready.notify_one();
+	}
+
+	/**
+	 * run the tasks of the group until all of them are done, sleeping while the others run the rest
+	 */
+	void wait(queue* q) {
+		std::unique_lock<std::mutex> guard(lock);
+		while (q->pending) {
+			if (q->tasks.empty()) {
+				q->ready.wait(guard);
+				continue;
+			}
+			execute(q, guard);
+		}
+	}
+
+	/**
+	 * the loop of a worker, which takes the next task of the groups in turn, starting from a different group each time
+	 */
+	void work(size_t index) {
+		std::unique_lock<std::mutex> guard(lock);
+		for (size_t turn = index; !quit; turn++) {
+			queue* q = nullptr;
+			for (size_t i = 0; !q && i < groups.size(); i++) {
+				queue* next = groups[(turn + i) % groups.size()];
+				if (next->tasks.size()) q = next;
+			}
+			if (!q) {
+				wake.wait(guard);
+				continue;
+			}
+			execute(q, guard);
+		}
+	}
+
+	/**
+	 * run the front task of the group outside the lock
+	 */
+	void execute(queue* q, std::unique_lock<std::mutex>& guard) {
+		std::function<void()> task = std::move(q->tasks.front());
+		q->tasks.pop_front();
+		guard.unlock();
+		task();
+		guard.lock();
+		if (--q->pending == 0) q->ready.notify_all();
+	}
+
+private:
+	size_t budget;
+	bool quit;
+	std::vector<std::thread> workers;
+	std::vector<queue*> groups;
+	std::mutex lock;
+	std::condition_variable wake;
+};
+
+/**
+ * a set of tasks which are waited for together, the tasks may add more tasks to their own group
+ */
+class task_group {
+public:
+	task_group() { scheduler::instance().attach(&q); }
+	~task_group() {
+		wait();
+		scheduler::instance().detach(&q);
+	}
+	task_group(const task_group&) = delete;
+	task_group& operator =(const task_group&) = delete;
+
+	void run(std::function<void()> task) { scheduler::instance().submit(&q, std::move(task)); }
+	void wait() { scheduler::instance().wait(&q); }
+
+private:
+	scheduler::queue q;
+};
@@ -0,0 +1,195 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * selfplay.h: Generate training data from the searched positions of local games
+ *
+ * the samples are streamed into binary shards, each shard starts with the header "NGS1"
+ * followed by size_x and size_y (1 byte each) and the sample size (uint16), then the samples
+ * follow one after another with a fixed size, each sample is stored as
+ *   uint8  the side to move (1 for black, 2 for white)
+ *   int8   the final result for the side to move (1 for win, -1 for loss)
+ *   uint8  the symmetry applied to the position (0 for the position as played)
+ *   uint8  reserved
+ *   one byte per point: the piece (0 for empty, 1 for black, 2 for white, 3 for hollow)
+ *   uint16 per point: the merged root visits of the move at the point
+ * all the integers are little-endian, the fixed layout is left uncompressed for external compressors
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "board.h"
+#include "agent.h"
+#include "episode.h"
+#include "arena.h"
+
+/**
+ * one searched position, before the game result is known
+ */
+struct sample {
+	board state;
+	unsigned who;
+	std::vector<std::pair<int, int>> visits;
+};
+
+class sample_writer {
+public:
+	enum { cells = board::size_x * board::size_y, sample_size = 4 + cells * 3 };
+
+	/**
+	 * write the shards as prefix-000000.ngs, prefix-000001.ngs, ..., each with at most shard samples
+	 */
+	sample_writer(const std::string& prefix, size_t shard = 100000)
+		: prefix(prefix), shard(std::max<size_t>(shard, 1)), index(0), written(0) {}
+
+	static std::string header() {
+		std::string buf("NGS1", 4);
+		buf.push_back(char(board::size_x));
+		buf.push_back(char(board::size_y));
+		buf.push_back(char(sample_size & 0xff));
+		buf.push_back(char(sample_size >> 8));
+		return buf;
+	}
+
+	/**
+	 * encode a sample with the given symmetry and append it to the buffer
+	 */
+	static void encode(const sample& smp, int result, unsigned s, std::string& buf) {
+		buf.push_back(char(smp.who));
+		buf.push_back(char(result));
+		buf.push_back(char(s));
+		buf.push_back(0);
+		std::array<uint16_t, cells> visits;
+		std::string piece(cells, '\0');
+		visits.fill(0);
+		for (int i = 0; i < cells; i++) piece[board::transform(i, s)] = char(smp.state(i));
+		for (const auto& v : smp.visits) {
+			if (v.first < 0 || v.first >= cells) continue;
+			visits[board::transform(v.first, s)] = std::min(v.second, 0xffff);
+		}
+		buf += piece;
+		for (uint16_t v : visits) {
+			buf.push_back(char(v & 0xff));
+			buf.push_back(char(v >> 8));
+		}
+	}
+
+	/**
+	 * append the samples of a finished game, with all the symmetries if augment is set
+	 */
+	void write(const std::vector<sample>& samples, unsigned winner, bool augment) {
+		std::string buf;
+		for (const sample& smp : samples) {
+			int result = smp.who == winner ? 1 : -1;
+			for (unsigned s = 0; s < (augment ? board::symmetries() : 1); s++) {
+				if (!out.is_open() || written >= shard) open_next();
+				buf.clear();
+				encode(smp, result, s, buf);
+				out.write(buf.data(), buf.size());
+				written++;
+			}
+		}
+		out.flush();
+	}
+
+protected:
+	void open_next() {
+		if (out.is_open()) out.close();
+		std::stringstream path;
+		path << prefix << "-" << std::setw(6) << std::setfill('0') << index++ << ".ngs";
+		out.open(path.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out << header();
+		written = 0;
+	}
+
+private:
+	std::string prefix;
+	size_t shard;
+	size_t index;
+	size_t written;
+	std::ofstream out;
+};
+
+/**
+ * play local games concurrently and write every searched position with its root visits and
+ * the final result, the games are written in order when they are judged
+ * the args are in the form of "out=selfplay shard=100000 symmetry=1"
+ */
+class selfplay : public arena {
+public:
+	selfplay(const std::string& black_args, const std::string& white_args, size_t parallel, const std::string& args)
+		: arena(black_args, white_args, parallel), augment(false), writer(option(args, "out", "selfplay"),
+		  std::stoull(option(args, "shard", "100000"))) {
+		augment = std::stoi(option(args, "symmetry", "0")) != 0;
+	}
+
+protected:
+	virtual void searched(size_t i, const board& state, const agent& who) {
+		sample smp;
+		if (!who.root_visits(smp.visits)) return;
+		unfold(smp.visits, state);
+		smp.state = state;
+		smp.who = state.info().who_take_turns;
+		std::lock_guard<std::mutex> guard(lock);
+		pending[i].push_back(std::move(smp));
+	}
+
+	virtual void judge(size_t i, const episode& game) {
+		std::vector<sample> samples;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			samples = std::move(pending[i]);
+			pending.erase(i);
+		}
+		unsigned winner = game.step() % 2 == 1 ? board::black : board::white; // the last mover wins
+		writer.write(samples, winner, augment);
+	}
+
+	/**
+	 * spread the visits of every move over its orbit under the symmetries of the state, when the other
+	 * moves of the orbit were not searched, e.g., pruned as equivalent by a player with symmetry=1
+	 * the visits are split evenly, and the remainder goes to the lowest points of the orbit
+	 */
+	static void unfold(std::vector<std::pair<int, int>>& visits, const board& state) {
+		unsigned stable = state.stabilizer();
+		if (stable == 1) return;
+		std::map<int, int> searched(visits.begin(), visits.end());
+		std::vector<std::pair<int, int>> unfolded;
+		for (const auto& v : visits) {
+			std::vector<int> orbit(1, v.first);
+			for (unsigned s = 1; s < board::symmetries(); s++) {
+				int p = board::transform(v.first, s);
+				if ((stable >> s & 1) && std::find(orbit.begin(), orbit.end(), p) == orbit.end()) orbit.push_back(p);
+			}
+			bool alone = std::none_of(orbit.begin() + 1, orbit.end(), [&](int p) { return searched.count(p); });
+			if (!alone) orbit.resize(1);
+			std::sort(orbit.begin(), orbit.end());
+			for (size_t k = 0; k < orbit.size(); k++) {
+				unfolded.emplace_back(orbit[k], v.second / int(orbit.size()) + (int(k) < v.second % int(orbit.size()) ? 1 : 0));
+			}
+		}
+		visits.swap(unfolded);
+	}
+
+	static std::string option(const std::string& args, const std::string& key, const std::string& value) {
+		std::string found = value;
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			if (pair.substr(0, pair.find('=')) == key) found = pair.substr(pair.find('=') + 1);
+		}
+		return found;
+	}
+
+private:
+	bool augment;
+	sample_writer writer;
+	std::mutex lock;
+	std::map<size_t, std::vector<sample>> pending;
+};
@@ -0,0 +1,280 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * server.h: Evaluate batches of positions on a shared pool of search threads
+ *
+ * the positions are read one per line from stdin, or from the connections of a local Unix socket,
+ *   <id> moves [E5 C3 ...]     the moves played from the initial board, black first
+ *   <id> board <b|w> <cells>   the side to move and one character per point in the order of
+ *                              A1, A2, ..., B1, ..., where . is empty, x is black, o is white, # is hollow
+ * every position is searched by one thread of the pool, and the result is written back as one
+ * JSON line as soon as it finishes, so the results may come back in a different order, e.g.,
+ * {"id":"p1","to_play":"b","best":"E5","sims":2000,"ms":41,"moves":[{"move":"E5","visits":312,"winrate":0.5312}]}
+ * a position which cannot be set up is answered with {"id":"p1","error":"..."}
+ */
+
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "board.h"
+#include "agent.h"
+#include "scheduler.h"
+
+class server {
+public:
+	/**
+	 * the options are given as key=value pairs, e.g., "thread=8 N=2000 socket=/tmp/nogo.sock"
+	 *   thread  the search threads shared by all the positions (all the cores by default, or --cores)
+	 *   N       the simulations of every position, used unless T is given
+	 *   T       the milliseconds of every position
+	 *   c       the exploration constant
+	 *   mem     the memory cap of all the trees in MiB, split between the threads
+	 *   seed    seeds the search of the i-th position with seed and i, otherwise the clock is used
+	 *   top     the candidates listed per position
+	 *   socket  listen on this path instead of reading stdin
+	 */
+	server(const std::string& args = "") : threads(std::max(1u, std::thread::hardware_concurrency())),
+		sims(2000), millis(0), c(0.3), mem(0), seed(0), seeded(false), top(5), serial(0), closed(false) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			std::string value = pair.substr(pair.find('=') + 1);
+			if (key == "thread") threads = std::max(1, std::stoi(value));
+			if (key == "N") sims = std::max(1, std::stoi(value));
+			if (key == "T") millis = std::stoull(value);
+			if (key == "c") c = std::stof(value);
+			if (key == "mem") mem = std::stod(value) * (1 << 20);
+			if (key == "seed") seed = std::stoull(value), seeded = true;
+			if (key == "top") top = std::stoul(value);
+			if (key == "socket") path = value;
+		}
+	}
+
+public:
+	/**
+	 * serve stdin until it is closed and every position is answered, or serve the socket forever
+	 */
+	int run() {
+		std::vector<std::thread> pool; // with a core budget, the positions are tasks of the scheduler instead
+		for (size_t i = 0; i < threads && !scheduler::instance().enabled(); i++) pool.emplace_back(&server::work, this);
+		int code = path.size() ? listen() : 0;
+		if (path.empty()) {
+			std::cout << std::flush;
+			read(std::make_shared<channel>(0, 1, false));
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closed = true;
+		}
+		wake.notify_all();
+		for (std::thread& th : pool) th.join();
+		tasks.wait();
+		return code;
+	}
+
+protected:
+	/**
+	 * where the positions come from and the results go to, closed once nothing refers to it
+	 */
+	struct channel {
+		int in, out;
+		bool socket;
+		std::mutex lock;
+		channel(int in, int out, bool socket) : in(in), out(out), socket(socket) {}
+		~channel() { if (socket) ::close(in); }
+		void write(const std::string& line) {
+			std::lock_guard<std::mutex> guard(lock);
+			for (size_t done = 0; done < line.size(); ) {
+				ssize_t n = socket ? ::send(out, line.data() + done, line.size() - done, MSG_NOSIGNAL)
+				                   : ::write(out, line.data() + done, line.size() - done);
+				if (n <= 0) return; // the peer is gone, the result is dropped
+				done += n;
+			}
+		}
+	};
+
+	struct job {
+		std::string id;
+		board state;
+		size_t index;
+		std::shared_ptr<channel> reply;
+	};
+
+	/**
+	 * accept the connections on the socket, every connection is read by its own thread
+	 */
+	int listen() {
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (fd < 0 || path.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "cannot open socket " << path << std::endl;
+			return 1;
+		}
+		std::copy(path.begin(), path.end(), addr.sun_path);
+		::unlink(path.c_str());
+		if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+			std::cerr << "cannot listen on " << path << std::endl;
+			::close(fd);
+			return 1;
+		}
+		std::cout << "listening on " << path << std::endl;
+		for (int conn; (conn = ::accept(fd, nullptr, nullptr)) >= 0 || errno == EINTR; ) {
+			if (conn < 0) continue;
+			std::thread(&server::read, this, std::make_shared<channel>(conn, conn, true)).detach();
+		}
+		::close(fd);
+		return 1;
+	}
+
+	/**
+	 * queue every position read from the channel, and answer the malformed ones right away
+	 */
+	void read(std::shared_ptr<channel> from) {
+		std::string buf, line;
+		char chunk[4096];
+		for (bool eof = false; !eof; ) {
+			ssize_t n = ::read(from->in, chunk, sizeof(chunk));
+			if (n > 0) buf.append(chunk, n);
+			else if (n < 0 && errno == EINTR) continue;
+			else eof = true;
+			for (size_t nl; (nl = buf.find('\n')) != std::string::npos || (eof && buf.size()); ) {
+				line = buf.substr(0, nl);
+				buf.erase(0, nl == std::string::npos ? nl : nl + 1);
+				if (line.size() && line.back() == '\r') line.pop_back();
+				if (line.empty()) continue;
+				job next = { "", board(), 0, from };
+				std::string error = parse(line, next);
+				if (error.size()) {
+					from->write("{\"id\":\"" + escape(next.id) + "\",\"error\":\"" + escape(error) + "\"}\n");
+					continue;
+				}
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					next.index = serial++;
+					if (!scheduler::instance().enabled()) queue.push_back(next);
+				}
+				if (scheduler::instance().enabled()) tasks.run([this, next]() { next.reply->write(evaluate(next)); });
+				else wake.notify_one();
+			}
+		}
+	}
+
+	/**
+	 * set up the position of a request line, or return what is wrong with it
+	 */
+	static std::string parse(const std::string& line, job& next) {
+		std::stringstream ss(line);
+		std::string kind;
+		ss >> next.id >> kind;
+		if (kind == "moves") {
+			for (std::string move; ss >> move; ) {
+				board::point p(move);
+				if (p.x < 0 || p.x >= board::size_x || p.y < 0 || p.y >= board::size_y) return "bad move " + move;
+				if (next.state.place(p) != board::legal) return "illegal move " + move;
+			}
+			return "";
+		} else if (kind == "board") {
+			std::string side, cells;
+			ss >> side >> cells;
+			if (side != "b" && side != "w") return "bad side to move " + side;
+			if (cells.size() != size_t(board::size_x * board::size_y)) return "bad board size";
+			for (size_t i = 0; i < cells.size(); i++) {
+				size_t type = std::string(".xo#").find(std::tolower(cells[i]));
+				if (type == std::string::npos) return std::string("bad point ") + cells[i];
+				next.state(i) = type;
+			}
+			next.state.info({ side == "b" ? board::black : board::white });
+			return "";
+		}
+		return "unknown request " + kind;
+	}
+
+	/**
+	 * the loop of a pool thread: search the next queued position until the server is closed
+	 */
+	void work() {
+		while (true) {
+			job next;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [this]() { return closed || queue.size(); });
+				if (queue.empty()) return;
+				next = std::move(queue.front());
+				queue.pop_front();
+			}
+			next.reply->write(evaluate(next));
+		}
+	}
+
+	/**
+	 * search the position of the job on a fresh tree, and format the result
+	 */
+	std::string evaluate(const job& next) {
+		board::piece_type who = next.state.info().who_take_turns;
+		std::stringstream out;
+		out << "{\"id\":\"" << escape(next.id) << "\",\"to_play\":\"" << (who == board::black ? 'b' : 'w') << "\"";
+
+		uint64_t start = time_compare::millisec();
+		node* root = new node(next.state);
+		mcts_management search(who, 0, sims, 277, 0, c);
+		if (millis) search.timed(start + millis, start + millis, 0, false);
+		else search.counted(sims);
+		if (seeded) search.seed(mcts_action::stream_seed(seed, 0, next.index));
+		if (mem) search.memory(mem / threads, true);
+		search(next.state, root);
+		uint64_t elapsed = time_compare::millisec() - start;
+
+		std::vector<const node*> order(root->level_vector.begin(), root->level_vector.end());
+		std::sort(order.begin(), order.end(), [](const node* a, const node* b) {
+			return a->visit_count != b->visit_count ? a->visit_count > b->visit_count : a->move_position < b->move_position;
+		});
+		out << ",\"best\":\"" << (order.size() ? board::point(order[0]->move_position) : board::point()) << "\"";
+		out << ",\"sims\":" << int(root->visit_count) << ",\"ms\":" << elapsed << ",\"moves\":[";
+		for (size_t i = 0; i < std::min(order.size(), top); i++) {
+			double winrate = order[i]->visit_count ? order[i]->win_count / order[i]->visit_count : 0;
+			out << (i ? "," : "") << "{\"move\":\"" << board::point(order[i]->move_position) << "\",\"visits\":"
+			    << int(order[i]->visit_count) << ",\"winrate\":" << winrate << "}";
+		}
+		out << "]}\n";
+		delete root;
+		return out.str();
+	}
+
+	static std::string escape(const std::string& text) {
+		std::string quoted;
+		for (char ch : text) {
+			if (ch == '"' || ch == '\\') quoted.push_back('\\');
+			quoted.push_back(ch);
+		}
+		return quoted;
+	}
+
+private:
+	size_t threads;
+	int sims;
+	uint64_t millis;
+	float c;
+	int64_t mem;
+	uint64_t seed;
+	bool seeded;
+	size_t top;
+	std::string path;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<job> queue;
+	size_t serial;
+	bool closed;
+	task_group tasks;
+};
@@ -9,12 +9,15 @@
 
 #pragma once
 #include <deque>
+#include <memory>
 #include <algorithm>
 #include <iostream>
 #include <sstream>
 #include "board.h"
 #include "action.h"
 #include "episode.h"
+#include "record.h"
+#include "latency.h"
 
 class statistics {
 public:
@@ -47,24 +50,18 @@ public:
 	 *  'ops = 125762 (132018|135377)': the average speed is 125762
 	 *                                  the average speed of black is 132018
 	 *                                  the average speed of white is 135377
+	 *
+	 * followed by one line per agent with the move latency of each phase since the start, e.g.,
+	 *   black:tcg_judge: opening = 12|19|31|40, middle = 9|15|27|33, endgame = 1|3|7|12
+	 * where '12|19|31|40' are the p50|p90|p99|max of the time per move in milliseconds
 	 */
 	void show(size_t blk = 0) const {
-		size_t num = std::min(data.size(), blk ?: block);
-		size_t sop = 0, Bop = 0, Wop = 0;
-		time_t sdu = 0, Bdu = 0, Wdu = 0;
-		size_t BW = 0, WW = 0;
-		auto it = data.end();
-		for (size_t i = 0; i < num; i++) {
-			auto& ep = *(--it);
-			if (ep.step() % 2 == 1) BW++;
-			else                    WW++;
-			sop += ep.step();
-			Bop += ep.step(action::black::type);
-			Wop += ep.step(action::white::type);
-			sdu += ep.time();
-			Bdu += ep.time(action::black::type);
-			Wdu += ep.time(action::white::type);
-		}
+		size_t num = std::min(sums.size(), blk ?: block);
+		tally last = sums.size() ? sums.back() : base;
+		tally t = last - (num < sums.size() ? sums[sums.size() - 1 - num] : base);
+		size_t sop = t.sop, Bop = t.Bop, Wop = t.Wop;
+		time_t sdu = t.sdu, Bdu = t.Bdu, Wdu = t.Wdu;
+		size_t BW = t.BW, WW = t.WW;
 
 		std::cout << count << "\t";
 		std::cout << "win = " << (BW * 100.0 / num) << "%"
@@ -76,6 +73,7 @@ public:
 		          <<     " (" << (Bop * 1000.0 / Bdu)
 		          <<      "|" << (Wop * 1000.0 / Wdu) << ")";
 		std::cout << std::endl;
+		lat.show(std::cout);
 	}
 
 	void summary() const {
@@ -86,18 +84,35 @@ public:
 		return count >= total;
 	}
 
+	size_t remaining() const {
+		return total > count ? total - count : 0;
+	}
+
 	bool is_episode_ongoing() const {
 		return data.size() && data.back().time() < 0;
 	}
 
 	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
+		if (count++ >= limit) pop_front();
 		data.emplace_back();
 		data.back().open_episode(flag);
 	}
 
 	void close_episode(const std::string& flag = "") {
 		data.back().close_episode(flag);
+		account(data.back());
+		if (recorder) recorder->append(data.back());
+		if (count % block == 0) show();
+	}
+
+	/**
+	 * append an episode which has been played elsewhere, e.g., by the arena
+	 */
+	void push_episode(const episode& ep) {
+		if (count++ >= limit) pop_front();
+		data.push_back(ep);
+		account(ep);
+		if (recorder) recorder->append(ep);
 		if (count % block == 0) show();
 	}
 
@@ -114,6 +129,39 @@ public:
 		return count;
 	}
 
+	/**
+	 * append every episode to the binary record file as soon as it is finished
+	 */
+	void record(const std::string& path) {
+		recorder = std::make_shared<record_writer>(path);
+	}
+
+	/**
+	 * load the episodes from a binary record file, as the text format does with operator >>
+	 * every episode is accounted as it is read, and only the last 'limit' of them are kept, as push_episode does
+	 */
+	void load_record(const std::string& path) {
+		record_reader reader(path);
+		size_t keep = limit ? limit : -1; // no limit only with --total=0, i.e., the records are converted
+		for (episode ep; reader.next(ep); ) {
+			if (count++ >= keep) pop_front();
+			data.push_back(std::move(ep));
+			account(data.back());
+		}
+		total = std::max(total, count);
+	}
+
+	void save_record(const std::string& path) const {
+		record_writer::save(path, data);
+	}
+
+	/**
+	 * the move latency histograms of all the episodes since the start
+	 */
+	const latency& latencies() const {
+		return lat;
+	}
+
 	friend std::ostream& operator <<(std::ostream& out, const statistics& stat) {
 		for (const episode& rec : stat.data) out << rec << std::endl;
 		return out;
@@ -122,16 +170,60 @@ public:
 		for (std::string line; std::getline(in, line) && line.size(); ) {
 			stat.data.emplace_back();
 			std::stringstream(line) >> stat.data.back();
+			stat.account(stat.data.back());
 		}
 		stat.total = std::max(stat.total, stat.data.size());
 		stat.count = stat.data.size();
 		return in;
 	}
 
+protected:
+	/**
+	 * the running sums of the finished episodes, so that any window of them is a subtraction
+	 */
+	struct tally {
+		size_t BW, WW, sop, Bop, Wop;
+		time_t sdu, Bdu, Wdu;
+		tally() : BW(0), WW(0), sop(0), Bop(0), Wop(0), sdu(0), Bdu(0), Wdu(0) {}
+		tally operator -(const tally& t) const {
+			tally d;
+			d.BW = BW - t.BW; d.WW = WW - t.WW;
+			d.sop = sop - t.sop; d.Bop = Bop - t.Bop; d.Wop = Wop - t.Wop;
+			d.sdu = sdu - t.sdu; d.Bdu = Bdu - t.Bdu; d.Wdu = Wdu - t.Wdu;
+			return d;
+		}
+	};
+
+	void account(const episode& ep) {
+		tally t = sums.size() ? sums.back() : base;
+		if (ep.step() % 2 == 1) t.BW++;
+		else                    t.WW++;
+		t.sop += ep.step();
+		t.Bop += ep.step(action::black::type);
+		t.Wop += ep.step(action::white::type);
+		t.sdu += ep.time();
+		t.Bdu += ep.time(action::black::type);
+		t.Wdu += ep.time(action::white::type);
+		sums.push_back(t);
+		lat.account(ep);
+	}
+
+	void pop_front() {
+		data.pop_front();
+		if (sums.size()) {
+			base = sums.front();
+			sums.pop_front();
+		}
+	}
+
 private:
 	size_t total;
 	size_t block;
 	size_t limit;
 	size_t count;
 	std::deque<episode> data;
+	std::shared_ptr<record_writer> recorder;
+	std::deque<tally> sums; // the running sums up to each finished episode in data
+	tally base; // the running sums before the first episode in data
+	latency lat;
 };
@@ -0,0 +1,293 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * test.cpp: Checks of the search bookkeeping which games alone cannot reveal
+ *
+ * every check prints one line, and the program exits with 1 if any of them fails
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "selfplay.h"
+#include "scheduler.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	std::cout << (ok ? "pass " : "FAIL ") << what << std::endl;
+	if (!ok) failures++;
+}
+
+/**
+ * a move gets its budget plus the bank, and only the time it leaves before its limit is banked again
+ */
+static void test_time_bank() {
+	const int64_t budget = 100;
+	int64_t bank = budget;
+	uint64_t start = 1000, limit = start + budget + bank;
+
+	bank = mcts_action::banked(limit, limit, budget);
+	check(bank == 0, "a move which runs to its limit spends the whole bank");
+
+	limit = start + budget + bank;
+	bank = mcts_action::banked(limit, start + 40, budget);
+	check(bank == 60, "a move which stops early banks only what it left");
+
+	limit = start + budget + bank;
+	bank = mcts_action::banked(limit, start + 100, budget);
+	check(bank == 60, "a move which uses exactly its budget keeps the bank");
+
+	limit = start + budget + bank;
+	bank = mcts_action::banked(limit, start + 130, budget);
+	check(bank == 30, "a move which spends part of the bank shrinks it");
+
+	bank = mcts_action::banked(start, start + 500, budget);
+	check(bank == 0, "a move past its limit leaves no negative bank");
+
+	bank = mcts_action::banked(start + 1000, start, budget);
+	check(bank == budget, "the bank is capped at one budget");
+}
+
+/**
+ * whether every child in the subtree is the lowest point of its orbit under the symmetries of its position
+ */
+static bool canonical(const node* n, const board& state) {
+	for (const node* child : n->level_vector) {
+		board after = state;
+		after.place_at(child->move_position);
+		if (!node::representative(child->move_position, state.stabilizer()) || !canonical(child, after)) return false;
+	}
+	return true;
+}
+
+/**
+ * expand the symmetric tree to the given depth
+ */
+static void expand(node* n, const board& state, int depth) {
+	if (depth == 0) return;
+	n->level_vec_init(state, true);
+	for (node* child : n->level_vector) {
+		board after = state;
+		after.place_at(child->move_position);
+		expand(child, after, depth - 1);
+	}
+}
+
+/**
+ * a subtree taken over by a symmetry is mapped back to the moves a fresh tree of the new position expands
+ */
+static void test_canonicalize() {
+	board empty;
+	node root(empty);
+	expand(&root, empty, 3);
+	check(canonical(&root, empty), "a symmetric tree expands only the lowest point of every orbit");
+
+	int taken = 0;
+	for (unsigned s = 1; s < board::symmetries(); s++) {
+		for (node* child : root.level_vector) {
+			int move = board::transform(child->move_position, s);
+			if (move == child->move_position) continue;
+			board after = empty;
+			after.place_at(move);
+			node* copy = new node(empty);
+			copy->move_position = child->move_position;
+			copy->empty_vector = child->empty_vector;
+			board before = empty;
+			before.place_at(child->move_position);
+			expand(copy, before, 2);
+			copy->transform(s);
+			copy->canonicalize(after);
+			if (canonical(copy, after)) taken++;
+			else check(false, "the subtree of move " + std::to_string(child->move_position) + " under symmetry " + std::to_string(s));
+			delete copy;
+		}
+	}
+	check(taken > 0, "every transformed subtree is canonical again (" + std::to_string(taken) + " subtrees)");
+}
+
+/**
+ * the visits of a move searched alone are spread over its orbit, and the total is kept
+ */
+struct unfolding : selfplay {
+	using selfplay::unfold;
+};
+
+static void test_unfold() {
+	board empty;
+	node symmetric(empty), full(empty);
+	symmetric.level_vec_init(empty, true);
+	full.level_vec_init(empty, false);
+	std::vector<std::pair<int, int>> visits;
+	int total = 0;
+	for (size_t i = 0; i < symmetric.level_vector.size(); i++) {
+		visits.emplace_back(symmetric.level_vector[i]->move_position, 10 + i);
+		total += 10 + i;
+	}
+	unfolding::unfold(visits, empty);
+	int unfolded = 0;
+	for (const auto& v : visits) unfolded += v.second;
+	check(visits.size() == full.level_vector.size(), "the visits of the pruned moves cover every legal move");
+	check(unfolded == total, "the spread visits keep the total");
+
+	std::vector<std::pair<int, int>> searched;
+	for (const node* child : full.level_vector) searched.emplace_back(child->move_position, 3);
+	std::vector<std::pair<int, int>> kept = searched;
+	unfolding::unfold(kept, empty);
+	check(kept == searched, "the visits of a search without pruning are kept as they are");
+}
+
+static size_t subtree(const node* n) {
+	size_t bytes = n->bytes();
+	for (const node* child : n->level_vector) bytes += subtree(child);
+	return bytes;
+}
+
+/**
+ * the counted bytes follow the expansions, collapses and deletions, although they are counted per subtree
+ */
+static void test_node_bytes() {
+	node_bytes_counted() = true;
+	int64_t base = node_bytes();
+	board empty;
+	node* root = new node(empty);
+	expand(root, empty, 3);
+	check(node_bytes() - base == int64_t(subtree(root)), "an expanded tree is counted with all its nodes");
+	root->level_vector[0]->collapse();
+	root->level_vector[1]->level_vector[0]->collapse();
+	check(node_bytes() - base == int64_t(subtree(root)), "a collapsed subtree is no longer counted");
+	delete root;
+	check(node_bytes() == base, "a deleted tree leaves nothing counted");
+	node_bytes_counted() = false;
+}
+
+/**
+ * a node with the given children counts, laid out and padded as level_vec_init and Backpropagation do
+ */
+static void fill(node& n, const std::vector<std::pair<int, int>>& counts) {
+	for (node* child : n.level_vector) delete child;
+	n.level_vector.clear();
+	n.visit_count = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		n.level_vector.push_back(new node());
+		n.level_vector.back()->win_count = counts[i].first;
+		n.level_vector.back()->visit_count = counts[i].second;
+		n.visit_count += counts[i].second;
+	}
+	n.child_stats.assign(n.stride() * 2, 0);
+	for (size_t i = 0; i < n.stride(); i++) {
+		n.child_wins()[i] = i < counts.size() ? counts[i].first : -1e30f;
+		n.child_visits()[i] = i < counts.size() ? counts[i].second : 1;
+	}
+}
+
+/**
+ * the selection before the child statistics, in double: the first unvisited child, or the first highest UCT score
+ */
+static int select_reference(const node& n, double c, std::vector<double>& scores) {
+	scores.clear();
+	int choice = -1;
+	double best = -2;
+	for (size_t i = 0; i < n.level_vector.size(); i++) {
+		const node* child = n.level_vector[i];
+		if (child->visit_count == 0) return i;
+		scores.push_back(child->win_count / child->visit_count + c * std::sqrt(std::log(n.visit_count) / child->visit_count));
+		if (best < scores.back()) {
+			best = scores.back();
+			choice = i;
+		}
+	}
+	return choice;
+}
+
+/**
+ * the SSE2 and the scalar selection pick the child of the old formula, with unvisited children and ties,
+ * apart from the scores too close for the float tables to tell apart
+ */
+static void test_select() {
+	std::mt19937 engine(2022);
+	const float c = 0.3;
+	node n;
+	std::vector<double> scores;
+	int trials = 20000, unvisited = 0, tied = 0, scalar_wrong = 0, sse2_wrong = 0;
+	for (int t = 0; t < trials; t++) {
+		size_t size = 1 + engine() % 80;
+		int range = 1 + engine() % (t % 2 ? 5000 : 12); // few visits make many exact ties
+		std::vector<std::pair<int, int>> counts;
+		for (size_t i = 0; i < size; i++) {
+			int visits = engine() % 8 == 0 && t % 3 == 0 ? 0 : 1 + engine() % range;
+			counts.emplace_back(engine() % (visits + 1), visits);
+		}
+		fill(n, counts);
+		int expect = select_reference(n, c, scores);
+		int scalar = mcts_tree::select_scalar(&n, c);
+		if (n.level_vector[expect]->visit_count == 0) unvisited++;
+		else if (std::count(scores.begin(), scores.end(), scores[expect]) > 1) tied++;
+		auto wrong = [&](int got) {
+			if (got == expect) return false;
+			if (n.level_vector[expect]->visit_count == 0 || n.level_vector[got]->visit_count == 0) return true;
+			return std::abs(scores[got] - scores[expect]) > 1e-5;
+		};
+		scalar_wrong += wrong(scalar);
+#ifdef __SSE2__
+		sse2_wrong += wrong(mcts_tree::select_sse2(&n, c));
+#endif
+	}
+	check(unvisited > 0 && tied > 0, "the random nodes include unvisited children (" + std::to_string(unvisited)
+		+ ") and exact ties (" + std::to_string(tied) + ")");
+	check(scalar_wrong == 0, "the scalar selection picks the child of the old formula");
+#ifdef __SSE2__
+	check(sse2_wrong == 0, "the SSE2 selection picks the child of the old formula, as the scalar one does");
+#endif
+	fill(n, {});
+}
+
+/**
+ * the root visits of one deterministic search of the position, by a fresh player
+ */
+static std::unordered_map<int, int> deterministic_search(const board& state, const std::string& args) {
+	mcts_action player("c=0.3 N=100 T=10005 thread=1 tm=0 ponder=0 margin=50 adaptive=1 search=mcts role=black name=test " + args);
+	return player.thread_simulate_result(state);
+}
+
+/**
+ * deterministic searches choose the same move from the same visits, whether the trees run on their own
+ * threads or as tasks of the scheduler
+ */
+static void test_deterministic() {
+	board state;
+	const std::string args[] = { "thread=2 N=2000 deterministic=1 seed=7", "thread=3 N=3000 deterministic=1 seed=11 mem=1" };
+	const int sims[] = { 2 * 2000, 3 * 3000 };
+	std::unordered_map<int, int> threads[2];
+	for (int i = 0; i < 2; i++) {
+		threads[i] = deterministic_search(state, args[i]);
+		int total = 0;
+		for (auto subn : threads[i]) total += subn.second;
+		check(total == sims[i], "the search of \"" + args[i] + "\" runs exactly N simulations per thread");
+		std::unordered_map<int, int> again = deterministic_search(state, args[i]);
+		check(again == threads[i] && mcts_action::best_move(again) == mcts_action::best_move(threads[i]),
+			"two threaded searches of \"" + args[i] + "\" are identical");
+	}
+	scheduler::instance().start(2);
+	for (int i = 0; i < 2; i++) {
+		std::unordered_map<int, int> tasks = deterministic_search(state, args[i]);
+		check(tasks == threads[i] && mcts_action::best_move(tasks) == mcts_action::best_move(threads[i]),
+			"the search of \"" + args[i] + "\" on the scheduler is identical to the threaded one");
+	}
+}
+
+int main() {
+	test_time_bank();
+	test_canonicalize();
+	test_unfold();
+	test_select();
+	test_node_bytes();
+	test_deterministic(); // the last one, since it starts the scheduler
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * tuning.h: Tune the numeric options of a player by SPSA with batches of local games
+ *
+ * the args are in the form of "c=0.3:0.05:2:0.1 tm_a=1.9:1:3:0.2 iterations=200 games=16 log=tune.log"
+ * where every name=value:min:max:step is a tuned option of the player, with its initial value, its bounds,
+ * and its perturbation at the last iteration, and the other pairs configure the tuning (see spsa::spsa)
+ * every iteration plays a batch of games between the player with all the options shifted by +step
+ * and the player with them shifted by -step in random directions, with alternating colors, and moves
+ * the options toward the side which won more; every iteration is appended to the log as
+ *   iteration=12 score=3 games=16 c=0.3124 tm_a=1.902
+ * and a tuning given the same log continues after its last iteration
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "board.h"
+#include "agent.h"
+#include "episode.h"
+#include "arena.h"
+
+class spsa : public arena {
+public:
+	/**
+	 * the base arguments of the tuned player, the number of games played at once, and the tuning args
+	 *   iterations  the iterations to run in total (default 100)
+	 *   games       the games of every iteration, rounded up to an even number (default 16)
+	 *   r           the learning rate at the last iteration, relative to step^2 (default 0.002)
+	 *   log         the file every iteration is appended to, and resumed from
+	 *   seed        seeds the random directions and the players
+	 */
+	spsa(const std::string& base, size_t parallel, const std::string& args)
+		: arena(base, base, parallel), iterations(100), games(16), rate(0.002), first(0), base_args(base) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			std::string value = pair.substr(pair.find('=') + 1);
+			if (value.find(':') != std::string::npos) {
+				option opt = { key, 0, 0, 0, 0 };
+				std::replace(value.begin(), value.end(), ':', ' ');
+				std::stringstream(value) >> opt.value >> opt.min >> opt.max >> opt.step;
+				options.push_back(opt);
+			}
+			if (key == "iterations") iterations = std::stoul(value);
+			if (key == "games") games = std::max<size_t>(2, (std::stoul(value) + 1) / 2 * 2);
+			if (key == "r") rate = std::stod(value);
+			if (key == "log") path = value;
+			if (key == "seed") seed = { unsigned(std::stoul(value)), unsigned(std::stoul(value)) };
+		}
+		if (path.size()) resume();
+	}
+
+public:
+	/**
+	 * run the remaining iterations, and print the tuned options
+	 */
+	void run() {
+		std::ofstream log;
+		if (path.size()) log.open(path, std::ios::out | std::ios::app);
+		for (size_t k = first; k < iterations; k++) {
+			std::vector<int> delta = directions(k);
+			double c = step_at(k);
+			args[0] = arena_args(delta, +c);
+			args[1] = arena_args(delta, -c);
+			int score = batch(k);
+
+			// the gain a_k = r step^2 ((A + N) / (A + k + 1))^alpha with A = N / 10, applied as a_k / c_k * score * delta
+			double gain = rate * std::pow((0.1 * iterations + iterations) / (0.1 * iterations + k + 1), 0.602);
+			for (size_t i = 0; i < options.size(); i++) {
+				option& opt = options[i];
+				double shift = gain * opt.step / c * score * delta[i];
+				opt.value = std::max(opt.min, std::min(opt.max, opt.value + shift));
+			}
+			std::string line = "iteration=" + std::to_string(k + 1) + " score=" + std::to_string(score)
+			                 + " games=" + std::to_string(games) + " " + values();
+			std::cout << line << std::endl;
+			if (log.is_open()) log << line << std::endl;
+		}
+		std::cout << "tuned = " << values() << std::endl;
+	}
+
+protected:
+	struct option {
+		std::string name;
+		double value, min, max, step;
+	};
+
+	/**
+	 * play the games of the k-th iteration on the workers, and return the wins of args[0] minus the wins of args[1]
+	 */
+	int batch(size_t k) {
+		std::atomic<size_t> next(0);
+		std::atomic<int> score(0);
+		auto worker = [&]() {
+			for (size_t j; (j = next++) < games; ) {
+				episode game;
+				size_t i = k * games + j; // the game index seeds the players differently in every iteration
+				play(i, game);
+				bool black_win = game.step() % 2 == 1;
+				score += (black_win == (black_of(i) == 0)) ? 1 : -1;
+			}
+		};
+		spread(worker, std::min(parallel, games));
+		return score;
+	}
+
+	virtual size_t black_of(size_t i) const { return i % 2; }
+
+	/**
+	 * the random +1 or -1 direction of every option in the k-th iteration, reproducible from the seed
+	 */
+	std::vector<int> directions(size_t k) const {
+		std::seed_seq seq = { seed[0], unsigned(k) };
+		std::mt19937 engine(seq);
+		std::vector<int> delta;
+		for (size_t i = 0; i < options.size(); i++) delta.push_back(engine() & 1 ? 1 : -1);
+		return delta;
+	}
+
+	/**
+	 * the perturbation of the k-th iteration relative to the step, c_k = (N / (k + 1))^gamma
+	 */
+	double step_at(size_t k) const {
+		return std::pow(double(iterations) / (k + 1), 0.101);
+	}
+
+	/**
+	 * the player args with every option shifted by c steps in its direction
+	 */
+	std::string arena_args(const std::vector<int>& delta, double c) const {
+		std::stringstream ss;
+		ss << base_args;
+		for (size_t i = 0; i < options.size(); i++) {
+			const option& opt = options[i];
+			ss << " " << opt.name << "=" << std::max(opt.min, std::min(opt.max, opt.value + c * opt.step * delta[i]));
+		}
+		return ss.str();
+	}
+
+	std::string values() const {
+		std::stringstream ss;
+		for (size_t i = 0; i < options.size(); i++) ss << (i ? " " : "") << options[i].name << "=" << options[i].value;
+		return ss.str();
+	}
+
+	/**
+	 * continue from the last iteration in the log, if any
+	 */
+	void resume() {
+		std::ifstream in(path);
+		for (std::string line; std::getline(in, line); ) {
+			std::stringstream ss(line);
+			for (std::string pair; ss >> pair; ) {
+				std::string key = pair.substr(0, pair.find('='));
+				std::string value = pair.substr(pair.find('=') + 1);
+				if (key == "iteration") first = std::stoul(value);
+				for (option& opt : options) if (opt.name == key) opt.value = std::stod(value);
+			}
+		}
+		if (first) std::cout << "resume from iteration " << first << ": " << values() << std::endl;
+	}
+
+private:
+	std::vector<option> options;
+	size_t iterations;
+	size_t games;
+	double rate;
+	std::string path;
+	size_t first;
+	std::string base_args;
+};